@@ -23,6 +23,8 @@
 #include "GameWin.h"
 #include "MainWin.h"
 #include "StatusBar.h"
+#include "Replay.h"
+#include "PathPlanner.h"
 
 //////////////////////////////////////////////////////////////////////
 int hex_style = 0;
@@ -40,6 +42,9 @@ int Map::simulation_thread(int)
     clock_t time0 = clock();
     clock_t last_sim = clock();
 
+    // Record everything needed to run this game again
+    replay_log.open( "simblob.rpl", seed_ );
+
     int phase = 0;
     for(;;)
     {
@@ -49,6 +54,10 @@ int Map::simulation_thread(int)
         
         last_sim = clock();
         simulate();
+        if( time_tick_ % TICKS_PER_DAY == 0 )
+            replay_log.checkpoint( time_tick_, tick_hash() );
+        if( time_tick_ % TICKS_PER_MONTH == 0 )
+            path_planner.report();
 
         // Keep a count of how many simulation ticks we do
         simcount++;
@@ -92,6 +101,7 @@ int Map::simulation_thread(int)
             DosSleep( w );
         }
     }
+    replay_log.close();
     return 0;
 }
 
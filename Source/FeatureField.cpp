@@ -0,0 +1,139 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "FeatureField.h"
+
+#include <algo.h>
+
+//////////////////////////////////////////////////////////////////////
+FeatureField::FeatureField( Terrain t )
+    :terrain(t), versions(-1), label(FEATURE_NONE)
+{
+}
+
+void FeatureField::refresh( Map& map )
+{
+    bool changed[NUM_SECTORS];
+    bool any = false;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        changed[s] = ( versions[s] != map.terrain_version_[terrain][s] );
+        if( changed[s] ) any = true;
+        versions[s] = map.terrain_version_[terrain][s];
+    }
+    if( !any )
+        return;
+
+    // Forget the hexes whose nearest feature was in a changed sector
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            long k = label[h];
+            if( k != FEATURE_NONE
+                && changed[sector( HexCoord( (k >> 8) & 0xff, k & 0xff ) )] )
+                label[h] = FEATURE_NONE;
+        }
+
+    // The search starts from the features in the changed sectors, and
+    // from the hexes just outside the forgotten area (which still have
+    // a good label).  open[d] has the hexes d steps from their feature.
+    vector< vector<HexCoord> > open(1);
+    for( TerrainSetIterator i( map.hexes(terrain) ); !i.done(); ++i )
+        if( changed[sector(*i)] )
+        {
+            label[*i] = feature_label( 0, *i );
+            open[0].push_back( *i );
+        }
+
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            if( label[h] != FEATURE_NONE )
+                continue;
+            for( int d = 0; d < 6; ++d )
+            {
+                HexCoord h2 = Neighbor( h, HexDirection(d) );
+                long k = map.valid(h2)? label[h2] : FEATURE_NONE;
+                if( k == FEATURE_NONE )
+                    continue;
+                int steps = k >> 16;
+                if( open.size() <= steps )
+                    open.insert( open.end(), steps+1-open.size(),
+                                 vector<HexCoord>() );
+                open[steps].push_back( h2 );
+            }
+        }
+
+    // Breadth-first search.  A hex can be in the lists more than once
+    // (if its label got better), so entries that don't match the label
+    // are skipped.
+    for( int steps = 0; steps < open.size(); ++steps )
+    {
+        for( int i = 0; i < open[steps].size(); ++i )
+        {
+            HexCoord h = open[steps][i];
+            long k = label[h];
+            if( ( k >> 16 ) != steps )
+                continue;
+
+            long next = k + ( 1L << 16 );
+            for( int d = 0; d < 6; ++d )
+            {
+                HexCoord h2 = Neighbor( h, HexDirection(d) );
+                if( !map.valid(h2) || next >= label[h2] )
+                    continue;
+                label[h2] = next;
+                if( open.size() <= steps+1 )
+                    open.push_back( vector<HexCoord>() );
+                open[steps+1].push_back( h2 );
+            }
+        }
+        open[steps].erase( open[steps].begin(), open[steps].end() );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Only the simulation thread asks for these, so they need no mutex
+
+FeatureField* Map::feature_field( Terrain t )
+{
+    if( feature_fields_[t] == NULL )
+        feature_fields_[t] = new FeatureField( t );
+    feature_fields_[t]->refresh( *this );
+    return feature_fields_[t];
+}
+
+HexCoord Map::nearest( const HexCoord& h, Terrain t )
+{
+    return feature_field(t)->nearest( h );
+}
+
+int Map::nearest_distance( const HexCoord& h, Terrain t )
+{
+    return feature_field(t)->distance( h );
+}
+
+void Map::forget_features()
+{
+    for( int t = 0; t < maxTerrain; ++t )
+    {
+        delete feature_fields_[t];
+        feature_fields_[t] = NULL;
+    }
+}
@@ -0,0 +1,64 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef FeatureField_h
+#define FeatureField_h
+
+// A feature field stores, for every hex on the map, the nearest hex with
+// one kind of terrain and how many steps away it is.  It is made with one
+// breadth-first search outward from all the hexes of that kind at once,
+// and after that each "where is the nearest market?" is answered by
+// looking at one hex.  The map makes a field the first time a kind of
+// terrain is asked about (Map::nearest).
+//
+// Ties go to the feature that comes first in m, then n order, so the
+// field depends only on the terrain and not on how it got that way.
+// That lets a field be repaired instead of remade: when set_terrain
+// changes a kind of terrain in a sector (Map::terrain_version_), only
+// the hexes whose nearest feature was in that sector are searched again.
+
+// Each label is the number of steps << 16 | the feature's m << 8 | n,
+// so that comparing labels compares distances and then positions
+const long FEATURE_NONE = 0x7fffffffL;
+
+inline long feature_label( int steps, const HexCoord& h )
+{
+    return ( long(steps) << 16 ) | ( h.m << 8 ) | h.n;
+}
+
+struct FeatureField
+{
+    Terrain terrain;
+    SectorArray<long> versions; // terrain_version_ when last brought up to date
+    MapArray<long> label;
+
+    FeatureField( Terrain t );
+    ~FeatureField() {}
+
+    void refresh( Map& map );
+
+    // Read the label at h; these don't refresh the field
+    HexCoord nearest( const HexCoord& h )   // (0,0) if there's none
+    {
+        long k = label[h];
+        return ( k == FEATURE_NONE )? HexCoord(0,0)
+            : HexCoord( int( (k >> 8) & 0xff ), int( k & 0xff ) );
+    }
+    int distance( const HexCoord& h )       // steps, or -1
+    {
+        long k = label[h];
+        return ( k == FEATURE_NONE )? -1 : int( k >> 16 );
+    }
+};
+
+#endif
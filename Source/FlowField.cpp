@@ -0,0 +1,182 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "FlowField.h"
+
+#include <algo.h>
+
+const int FLOW_CACHE_SIZE = 8;
+const int FLOW_MIN_AGE = 16;
+const int FLOW_UNREACHED = 0x3fffffff;
+
+FlowFieldCache flow_fields;
+
+//////////////////////////////////////////////////////////////////////
+FlowField::FlowField()
+    :target(0,0), tick(-1), last_used(0), div(-1),
+     versions(0), direction(DirNone)
+{
+}
+
+bool FlowField::current( Map& map, const HexCoord& h )
+{
+    if( h != target || div != int(path_div) )
+        return false;
+    if( map.time_tick_ - tick < FLOW_MIN_AGE && map.time_tick_ >= tick )
+        return true;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        if( versions[s] != map.cost_version_[s] )
+            return false;
+    return true;
+}
+
+struct FlowNode
+{
+    HexCoord loc;
+    int g;
+    FlowNode( const HexCoord& h, int g_ ): loc(h), g(g_) {}
+    FlowNode(): loc(), g(0) {}
+};
+
+inline bool operator > ( const FlowNode& a, const FlowNode& b )
+{
+    return a.g > b.g;
+}
+
+void FlowField::compute( Map& map, const HexCoord& h )
+{
+    target = h;
+    tick = map.time_tick_;
+    div = path_div;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        versions[s] = map.cost_version_[s];
+
+    // Dijkstra's algorithm, going backwards from the target: the cost
+    // at each hex is the cost of walking from it to the target
+    MapArray<int>* cost = new MapArray<int>( FLOW_UNREACHED );
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+            direction[HexCoord(m,n)] = DirNone;
+
+    greater<FlowNode> comp;
+    vector<FlowNode> open;
+    (*cost)[target] = 0;
+    open.push_back( FlowNode(target,0) );
+    while( !open.empty() )
+    {
+        pop_heap( open.begin(), open.end(), comp );
+        FlowNode N = open.back();
+        open.pop_back();
+        if( N.g > (*cost)[N.loc] )
+            continue;
+
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord h2 = Neighbor( N.loc, HexDirection(d) );
+            if( !map.valid(h2) )
+                continue;
+            int g = N.g + static_movement_cost( map, h2,
+                                                HexDirection( (d+3) % 6 ) );
+            if( g < (*cost)[h2] )
+            {
+                (*cost)[h2] = g;
+                // From h2, the step towards the target is the opposite way
+                direction[h2] = byte( (d+3) % 6 );
+                open.push_back( FlowNode(h2,g) );
+                push_heap( open.begin(), open.end(), comp );
+            }
+        }
+    }
+
+    delete cost;
+}
+
+//////////////////////////////////////////////////////////////////////
+FlowFieldCache::FlowFieldCache()
+    :fields_made(0), paths_followed(0)
+{
+}
+
+FlowFieldCache::~FlowFieldCache()
+{
+    for( vector<FlowField*>::iterator f = fields.begin();
+         f != fields.end(); ++f )
+        delete (*f);
+}
+
+FlowField* FlowFieldCache::field( Map& map, const HexCoord& target )
+{
+    // Look for the target, and also for the least recently used field
+    FlowField* oldest = NULL;
+    for( vector<FlowField*>::iterator f = fields.begin();
+         f != fields.end(); ++f )
+    {
+        if( (*f)->target == target )
+        {
+            if( !(*f)->current( map, target ) )
+            {
+                (*f)->compute( map, target );
+                fields_made++;
+            }
+            return (*f);
+        }
+        if( oldest == NULL || (*f)->last_used < oldest->last_used )
+            oldest = (*f);
+    }
+
+    FlowField* F = oldest;
+    if( fields.size() < FLOW_CACHE_SIZE )
+    {
+        F = new FlowField;
+        fields.push_back( F );
+    }
+    F->compute( map, target );
+    fields_made++;
+    return F;
+}
+
+bool FlowFieldCache::find_path( Map& map, const HexCoord& A,
+                                const HexCoord& B, vector<HexCoord>& path )
+{
+    Mutex::Lock lock( mutex );
+    FlowField* F = field( map, B );
+    F->last_used = map.time_tick_;
+
+    // Follow the arrows from A.  The arrows form a tree rooted at B, so
+    // this can't go around in circles, but the count is a safeguard.
+    vector<HexCoord> forward;
+    HexCoord h = A;
+    forward.push_back( h );
+    while( h != B && forward.size() < NUM_HEXES )
+    {
+        int d = F->direction[h];
+        if( d == DirNone )
+            return false;
+        h = Neighbor( h, HexDirection(d) );
+        forward.push_back( h );
+    }
+    if( h != B )
+        return false;
+
+    while( !forward.empty() )
+    {
+        path.push_back( forward.back() );
+        forward.pop_back();
+    }
+    paths_followed++;
+    return true;
+}
@@ -0,0 +1,69 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#ifndef FlowField_h
+#define FlowField_h
+
+// A flow field stores, for every hex on the map, which way to step to get
+// to one target hex.  It is made with one Dijkstra search outward from
+// the target, and then any number of blobs going to that target can get
+// a path by following the arrows, without searching.  When a big fire
+// starts, the firefighters from all the nearby watchtowers are sent to
+// the same places, so a few fields serve dozens of blobs.
+//
+// Fields are cached by target.  A field is remade when the movement costs
+// (Map::cost_version_) have changed, but not more often than once every
+// FLOW_MIN_AGE ticks; a slightly old field still leads to the target.
+// Like the sector graph, fields ignore blobs, which move every tick.
+
+struct FlowField
+{
+    HexCoord target;
+    long tick;                  // when this field was made
+    long last_used;
+    int div;                    // path_div when this field was made
+    SectorArray<long> versions; // cost_version_ when this field was made
+    MapArray<byte> direction;   // HexDirection towards the target
+
+    FlowField();
+    ~FlowField() {}
+
+    bool current( Map& map, const HexCoord& h );
+    void compute( Map& map, const HexCoord& h );
+};
+
+class FlowFieldCache
+{
+  public:
+    FlowFieldCache();
+    ~FlowFieldCache();
+
+    // Fill in a path (backwards, as for FindUnitPath) from A to B by
+    // following B's field.  Returns false if B can't be reached from A.
+    bool find_path( Map& map, const HexCoord& A, const HexCoord& B,
+                    vector<HexCoord>& path );
+
+    int fields_made;            // statistics
+    int paths_followed;
+
+  private:
+    Mutex mutex;
+    vector<FlowField*> fields;
+
+    FlowField* field( Map& map, const HexCoord& target );
+};
+
+inline void destroy( FlowField** ) {}
+
+extern FlowFieldCache flow_fields;
+
+#endif
@@ -23,6 +23,9 @@
 #include "MainWin.h"
 
 #include "StatusBar.h"
+#include "Rewind.h"
+#include "PathPlanner.h"
+#include "Landmarks.h"
 
 //////////////////////////////////////////////////////////////////////
 // Initialize the map terrain in a background thread
@@ -138,6 +141,15 @@ int GameWindow::initialization_thread(int)
     
     simulate_thread_id =
         Figment::begin_thread( closure( map, &Map::simulation_thread ) );
+    rewind_thread_id =
+        Figment::begin_thread( closure( &rewind_buffer,
+                                        &RewindBuffer::encoder_thread ) );
+    planner_thread_id =
+        Figment::begin_thread( closure( &path_planner,
+                                        &PathPlanner::planner_thread ) );
+    landmark_thread_id =
+        Figment::begin_thread( closure( &landmarks,
+                                        &Landmarks::landmark_thread ) );
     DosSleep( 100 );
     if( viewwin_ )
         viewwin_->painter_thread_id =
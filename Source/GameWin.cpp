@@ -44,6 +44,7 @@ bool GameWindow::bitmaps_initialized = false;
 
 GameWindow::GameWindow()
     :view_thread_id(0), init_thread_id(0), simulate_thread_id(0),
+     rewind_thread_id(0), planner_thread_id(0), landmark_thread_id(0),
      ps_window( NULL ), map( new Map ), viewwin_( NULL ), 
      statusbar_( NULL ), infoarea_( NULL ), buttonbar_( NULL ), 
      frame_( NULL ), palette( NULL ), horiz( NULL ), vert( NULL ),
@@ -91,6 +92,9 @@ void GameWindow::setup_window( Window* parent )
 
     menu.set_window( frame() );
     menu.toggle( ID_OPTIONS_DROUGHT, map->drought );
+    menu.toggle( ID_OPTIONS_SLEEP, map->sector_sleeping );
+    menu.toggle( ID_OPTIONS_LOD, map->level_of_detail );
+    menu.toggle( ID_OPTIONS_RESERVE, map->path_reservations );
 
     menu.value( ID_SPEED_SLOWER, map->game_speed, 1 );
     menu.value( ID_SPEED_SLOW, map->game_speed, 5 );
@@ -126,6 +130,8 @@ void GameWindow::setup_window( Window* parent )
     menu.command( ID_SPECIAL_FIRE, closure(this,&GameWindow::create_fire) );
     menu.command( ID_SPECIAL_ROADS,
                   closure(this,&GameWindow::create_road) );
+    menu.command( ID_SPECIAL_REWIND,
+                  closure(this,&GameWindow::rewind_day) );
     
     Closure<bool,int> erase_cmd = closure(this,&GameWindow::erase_map);
     menu.command( ID_SPECIAL_ERASE_ALL, erase_cmd );
@@ -160,6 +166,9 @@ GameWindow::~GameWindow()
 {
     Figment::kill_thread( view_thread_id );
     Figment::kill_thread( simulate_thread_id );
+    Figment::kill_thread( rewind_thread_id );
+    Figment::kill_thread( planner_thread_id );
+    Figment::kill_thread( landmark_thread_id );
     Figment::kill_thread( init_thread_id );
     
     if( palette != NULL ) viewwin_->unselect_palette( palette );
@@ -409,6 +418,13 @@ bool GameWindow::create_road(int)
     return true;
 }
 
+// Go back to yesterday, using the rewind buffer
+bool GameWindow::rewind_day(int)
+{
+    map_commands.push( Command::rewind() );
+    return true;
+}
+
 // Erase commands.. should these really be in the game?
 bool GameWindow::erase_map( int id )
 {
@@ -481,8 +497,8 @@ bool GameWindow::erase_map( int id )
     if( id == ID_SPECIAL_ERASE_UNIT || id == ID_SPECIAL_ERASE_ALL )
     {
         Mutex::Lock lock( map->unit_mutex );
-        for( vector<Unit*>::iterator u = map->units.begin();
-             u != map->units.end(); ++u )
+        for( vector<Unit*>::iterator u = map->live_units.begin();
+             u != map->live_units.end(); ++u )
         {
             if( !(*u)->dead() ) (*u)->die( map );
         }
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Map_Const.h"
+
+// The heat field spreads out from the fires, so that a watchtower (or a
+// blob) can tell whether a fire is nearby by looking at a single hex.
+// Each sweep is one explicit step of the diffusion equation: every hex
+// moves 1/8 of the way towards each of its six neighbors.  Walls don't
+// let any heat through, water soaks it up, and everywhere else a little
+// is lost on each sweep, so the field dies out about a dozen hexes from
+// a fire.  Burning hexes are held at HEAT_FIRE.  The flow is rounded to
+// the nearest unit and at least one unit is lost, so that once a fire
+// is out its heat goes all the way back to 0.
+//
+// The new values are built in temp_ and then copied back, so the result
+// doesn't depend on the order the hexes are visited in.  It takes about
+// a hundred sweeps for the field around a new fire to settle.
+
+int heat_interval = 4;          // ticks between updates (0 turns it off)
+int heat_sweeps = 2;            // diffusion steps per update
+
+// One part in HEAT_LOSS (rounded up) is lost from each dry hex on each
+// sweep
+const int HEAT_LOSS = 128;
+
+// flow/8, rounded to the nearest unit either way
+inline int heat_flow( int flow )
+{
+    return ( flow >= 0 )? ( flow + 4 ) / 8 : -( ( 4 - flow ) / 8 );
+}
+
+void Map::diffuse_heat()
+{
+    for( int sweep = 0; sweep < heat_sweeps; ++sweep )
+    {
+        for( int m = 1; m <= Map::MSize; ++m )
+            for( int n = 1; n <= Map::NSize; ++n )
+            {
+                HexCoord h(m,n);
+                Terrain t = terrain(h);
+                if( t == Fire )
+                {
+                    temp_[h] = HEAT_FIRE;
+                    continue;
+                }
+                if( t == Wall )
+                {
+                    temp_[h] = 0;
+                    continue;
+                }
+
+                int heat = heat_[h];
+                int flow = 0;
+                for( int d = 0; d < 6; ++d )
+                {
+                    HexCoord h2 = Neighbor( h, HexDirection(d) );
+                    if( valid(h2) && terrain(h2) != Wall )
+                        flow += heat_[h2] - heat;
+                }
+                heat += heat_flow( flow );
+
+                // Watery areas reduce heat
+                if( water_[h] > 0 )
+                    heat /= 2;
+                else if( heat > 0 )
+                    heat -= ( heat + HEAT_LOSS - 1 ) / HEAT_LOSS;
+                temp_[h] = heat;
+            }
+
+        for( int m = 1; m <= Map::MSize; ++m )
+            for( int n = 1; n <= Map::NSize; ++n )
+            {
+                HexCoord h(m,n);
+                heat_[h] = temp_[h];
+                temp_[h] = 0;
+            }
+    }
+}
@@ -519,7 +519,7 @@ struct MapInitializer
 
 void Map::initialize( Closure<bool,const char *> pause )
 {
-    randomize();
+    randomize( seed_ );
 
     // Fractal random terrain
     Pause( "Generating Terrain" );
@@ -582,6 +582,7 @@ void Map::initialize( Closure<bool,const char *> pause )
     }
 
     init.verify_terrain();
+    recompute_hash();
 }
 
 void Map::super_smooth_terrain()
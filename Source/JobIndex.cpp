@@ -0,0 +1,201 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Unit.h"
+#include "JobIndex.h"
+
+#include <algo.h>
+
+JobIndex job_index;
+
+// Jobs on the border are filed with the nearest sector
+static int job_sector_of( const HexCoord& h )
+{
+    HexCoord c( h );
+    if( c.m < 1 ) c.m = 1;
+    if( c.m > Map::MSize ) c.m = Map::MSize;
+    if( c.n < 1 ) c.n = 1;
+    if( c.n > Map::NSize ) c.n = Map::NSize;
+    return sector( c );
+}
+
+void JobIndex::insert( int i )
+{
+    remove( i );
+    if( i >= position.size() )
+    {
+        position.insert( position.end(), i+1-position.size(), -1 );
+        job_sector.insert( job_sector.end(), i+1-job_sector.size(), -1 );
+    }
+
+    int s = job_sector_of( jobs[i].location );
+    position[i] = open[s].size();
+    job_sector[i] = s;
+    open[s].push_back( i );
+    count++;
+}
+
+void JobIndex::remove( int i )
+{
+    if( i >= position.size() || position[i] < 0 )
+        return;
+
+    // Move the last job in the list into this one's place
+    vector<int>& list = open[job_sector[i]];
+    int p = position[i];
+    int last = list.back();
+    list[p] = last;
+    position[last] = p;
+    list.pop_back();
+    position[i] = -1;
+    count--;
+}
+
+int JobIndex::nearest( const HexCoord& h, int range ) const
+{
+    // A step changes m and n by at most one each, so the hex distance to
+    // anything in a sector is at least 10 times the larger of the gaps
+    vector< pair<int,int> > order;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        if( open[s].empty() )
+            continue;
+        HexCoord o = sector_origin( s );
+        int gap_m = max( 0, max( o.m - h.m, h.m - ( o.m+SECTOR_X_SIZE-1 ) ) );
+        int gap_n = max( 0, max( o.n - h.n, h.n - ( o.n+SECTOR_Y_SIZE-1 ) ) );
+        int bound = 10 * max( gap_m, gap_n );
+        if( bound < range )
+            order.push_back( pair<int,int>( bound, s ) );
+    }
+    sort( order.begin(), order.end() );
+
+    int best = -1, best_d = range;
+    for( int k = 0; k < order.size() && order[k].first < best_d; ++k )
+    {
+        const vector<int>& list = open[order[k].second];
+        for( int j = 0; j < list.size(); ++j )
+        {
+            int d = hex_distance( h, jobs[list[j]].location );
+            if( d < best_d )
+            {
+                best = list[j];
+                best_d = d;
+            }
+        }
+    }
+    return best;
+}
+
+// A builder and the job it might take next
+struct JobOffer
+{
+    int d;
+    int seeker;
+    int job;
+    JobOffer( int d_, int s, int j ): d(d_), seeker(s), job(j) {}
+    JobOffer(): d(0), seeker(0), job(0) {}
+};
+
+inline bool operator > ( const JobOffer& a, const JobOffer& b )
+{
+    if( a.d != b.d ) return a.d > b.d;
+    if( a.seeker != b.seeker ) return a.seeker > b.seeker;
+    return a.job > b.job;
+}
+
+void JobIndex::assign( Map* map )
+{
+    int n = seekers.size();
+    vector<HexCoord> from( n );
+    vector<int> range( n, 6000 );
+    vector<int> active( n, 0 );
+    for( int i = 0; i < n; ++i )
+    {
+        Unit* u = seekers[i];
+        if( u->dead() || u->busy() ) continue;
+        from[i] = u->hexloc();
+        active[i] = 1;
+    }
+
+    greater<JobOffer> comp;
+    for( int round = 0; round < Unit::MaxJobs; ++round )
+    {
+        vector<JobOffer> offers;
+        for( int i = 0; i < n; ++i )
+        {
+            if( !active[i] ) continue;
+            int j = nearest( from[i], range[i] );
+            if( j == -1 )
+                active[i] = 0;
+            else
+                offers.push_back(
+                    JobOffer( hex_distance( from[i], jobs[j].location ),
+                              i, j ) );
+        }
+        if( offers.empty() )
+            break;
+        make_heap( offers.begin(), offers.end(), comp );
+
+        while( !offers.empty() )
+        {
+            pop_heap( offers.begin(), offers.end(), comp );
+            JobOffer O = offers.back();
+            offers.pop_back();
+            int i = O.seeker;
+
+            if( !is_open( O.job ) )
+            {
+                // Someone closer took it, so look for another
+                int j = nearest( from[i], range[i] );
+                if( j == -1 )
+                    active[i] = 0;
+                else
+                {
+                    offers.push_back(
+                        JobOffer( hex_distance( from[i], jobs[j].location ),
+                                  i, j ) );
+                    push_heap( offers.begin(), offers.end(), comp );
+                }
+                continue;
+            }
+
+            if( round == 0 )
+            {
+                // Later jobs have to be in the same range as the first
+                int factor = 256;
+                while( factor > 1 && O.d >= 6000 / factor )
+                    factor /= 4;
+                range[i] = 6000 / factor;
+            }
+            seekers[i]->accept_job( O.job );
+            from[i] = jobs[O.job].location;
+            map->damage( from[i] );
+        }
+    }
+
+    // Start walking to the first job
+    for( int i = 0; i < n; ++i )
+    {
+        Unit* u = seekers[i];
+        if( u->dead() || u->jobs[0] == -1 || u->moving() || u->planning() )
+            continue;
+        u->agitated = 0;
+        u->set_dest( map, jobs[u->jobs[0]].location );
+    }
+    seekers.erase( seekers.begin(), seekers.end() );
+}
@@ -0,0 +1,70 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef JobIndex_h
+#define JobIndex_h
+
+// The job index keeps the open jobs (ones with something to build and
+// no blob working on them) in a list for each sector, so that an idle
+// builder can find the nearest one without looking through every job.
+// The sectors are searched closest first, and the search stops when no
+// job in the remaining sectors could be closer than the best so far.
+//
+// The Job functions in Unit.cpp keep the index up to date.  Each job
+// remembers its position in its sector's list, so taking a job out of
+// the index doesn't involve a search.
+//
+// Idle builders don't take jobs themselves.  They ask for work during
+// the tick, and at the end of the tick assign() hands out the jobs to
+// all of them at once.  It goes in rounds, one job per builder per
+// round, up to Unit::MaxJobs.  In each round the closest pair of builder
+// and job is matched first.  That way, a builder early in the units
+// list doesn't take a job that is right next to another builder.  In the
+// first round a builder looks from where it is standing; after that it
+// looks from its last job, within the same range as its first job.
+
+class Map;
+struct Unit;
+
+class JobIndex
+{
+  public:
+    JobIndex(): count(0) {}
+    ~JobIndex() {}
+
+    void insert( int i );       // job i is open
+    void remove( int i );       // job i isn't open anymore (or never was)
+
+    // The open job nearest to h, if one is closer than range, or -1
+    int nearest( const HexCoord& h, int range ) const;
+
+    int size() const { return count; }
+
+    // Builders that want work call this; assign() gives them jobs
+    void want_jobs( Unit* builder ) { seekers.push_back( builder ); }
+    void assign( Map* map );
+
+  private:
+    int count;
+    vector<Unit*> seekers;
+    vector<int> open[NUM_SECTORS];
+    vector<int> position;       // where each job is in open[], or -1
+    vector<int> job_sector;     // which list each job is in
+
+    bool is_open( int i ) const
+    { return i < position.size() && position[i] >= 0; }
+};
+
+extern JobIndex job_index;
+
+#endif
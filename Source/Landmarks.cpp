@@ -0,0 +1,216 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Landmarks.h"
+
+#include <algo.h>
+
+const int LANDMARK_INTERVAL = 256;  // ticks between copies, at most
+const int LANDMARK_DELAY = 16;      // ticks from copy to use
+
+Landmarks landmarks;
+
+// Around the edge of the map, so that most paths head away from one
+static const struct { int m, n; } landmark_hexes[NUM_LANDMARKS] =
+{
+    { 2, 2 },
+    { Map::MSize/2, 2 },
+    { Map::MSize-1, 2 },
+    { 2, Map::NSize-1 },
+    { Map::MSize/2, Map::NSize-1 },
+    { Map::MSize-1, Map::NSize-1 },
+};
+
+struct LandmarkNode
+{
+    HexCoord loc;
+    int g;
+    LandmarkNode( const HexCoord& h, int g_ ): loc(h), g(g_) {}
+    LandmarkNode(): loc(), g(0) {}
+};
+
+inline bool operator > ( const LandmarkNode& a, const LandmarkNode& b )
+{
+    return a.g > b.g;
+}
+
+Landmarks::Landmarks()
+    :div(-1), refreshes(0), running(false), busy(false), num_tables(0),
+     pending(false), handed_off(false), due(0), copied(-LANDMARK_INTERVAL),
+     version(-1), staging_version(0), staging_div(-1), staging(NULL)
+{
+    for( int i = 0; i < NUM_LANDMARKS; ++i )
+    {
+        dist[i] = NULL;
+        staging_dist[i] = NULL;
+    }
+}
+
+Landmarks::~Landmarks()
+{
+    for( int i = 0; i < NUM_LANDMARKS; ++i )
+    {
+        delete dist[i];
+        delete staging_dist[i];
+    }
+    delete staging;
+}
+
+void Landmarks::compute()
+{
+    // Dijkstra's algorithm outward from each landmark, over the copy
+    greater<LandmarkNode> comp;
+    vector<LandmarkNode> open;
+    for( int i = 0; i < NUM_LANDMARKS; ++i )
+    {
+        MapArray<int>& d = *staging_dist[i];
+        for( int m = 1; m <= Map::MSize; ++m )
+            for( int n = 1; n <= Map::NSize; ++n )
+                d[HexCoord(m,n)] = UNREACHABLE;
+
+        HexCoord L( landmark_hexes[i].m, landmark_hexes[i].n );
+        d[L] = 0;
+        open.push_back( LandmarkNode(L,0) );
+        while( !open.empty() )
+        {
+            pop_heap( open.begin(), open.end(), comp );
+            LandmarkNode N = open.back();
+            open.pop_back();
+            if( N.g > d[N.loc] )
+                continue;
+
+            const EdgeCosts& row = (*staging)[N.loc];
+            for( int k = 0; k < 6; ++k )
+            {
+                HexCoord h2 = Neighbor( N.loc, HexDirection(k) );
+                if( !Map::valid(h2) )
+                    continue;
+                int g = N.g + row.cost[k];
+                if( g < d[h2] )
+                {
+                    d[h2] = g;
+                    open.push_back( LandmarkNode(h2,g) );
+                    push_heap( open.begin(), open.end(), comp );
+                }
+            }
+        }
+    }
+}
+
+void Landmarks::update( Map& map )
+{
+    if( pending )
+    {
+        // (After a rewind, the tick can be before the copy)
+        if( map.time_tick_ < due && map.time_tick_ >= copied )
+            return;
+
+        if( handed_off )
+            while( busy )
+                finished.wait( 100 );
+        else
+            compute();
+
+        for( int i = 0; i < NUM_LANDMARKS; ++i )
+        {
+            MapArray<int>* t = dist[i];
+            dist[i] = staging_dist[i];
+            staging_dist[i] = t;
+        }
+        num_tables = NUM_LANDMARKS;
+        div = staging_div;
+        version = staging_version;
+        pending = false;
+        refreshes++;
+        return;
+    }
+
+    long v = 0;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        v += map.cost_version_[s];
+    if( map.edge_div_ < 0 || ( v == version && map.edge_div_ == div )
+        || ( map.time_tick_ >= copied
+             && map.time_tick_ - copied < LANDMARK_INTERVAL ) )
+        return;
+
+    if( staging == NULL )
+    {
+        staging = new MapArray<EdgeCosts>( EdgeCosts() );
+        for( int i = 0; i < NUM_LANDMARKS; ++i )
+            staging_dist[i] = new MapArray<int>( UNREACHABLE );
+    }
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            (*staging)[h] = step_costs( map, h );
+        }
+    staging_div = map.edge_div_;
+    staging_version = v;
+    copied = map.time_tick_;
+    due = map.time_tick_ + LANDMARK_DELAY;
+    pending = true;
+
+    handed_off = running;
+    if( handed_off )
+    {
+        busy = true;
+        finished.reset();
+        ready.post();
+    }
+}
+
+void Landmarks::build_now( Map& map )
+{
+    // Put any copy already made in use, then copy and put in use again
+    if( pending )
+    {
+        due = copied = map.time_tick_;
+        update( map );
+    }
+    version = -1;
+    copied = map.time_tick_ - LANDMARK_INTERVAL;
+    update( map );
+    due = copied = map.time_tick_;
+    update( map );
+}
+
+void Landmarks::forget()
+{
+    num_tables = 0;
+    div = -1;
+    version = -1;
+}
+
+int Landmarks::landmark_thread( int )
+{
+    running = true;
+    while( running )
+    {
+        if( !ready.wait( 500 ) )
+            continue;
+        ready.reset();
+        if( busy )
+        {
+            compute();
+            busy = false;
+            finished.post();
+        }
+    }
+    return 0;
+}
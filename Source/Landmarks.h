@@ -0,0 +1,91 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef Landmarks_h
+#define Landmarks_h
+
+// Landmarks give A* a better estimate of the distance left.  For a few
+// landmark hexes around the edge of the map we know the cost of the best
+// path from the landmark to every hex (ignoring blobs).  By the triangle
+// inequality, a path from a to b costs at least dist[b] - dist[a] for
+// each landmark, which knows about walls, water, and hills where the
+// hex distance doesn't.
+//
+// When the terrain costs change, the tables are recomputed from a copy
+// of the step cost cache.  The copy is made at the start of a planning
+// batch and the new tables are put in use LANDMARK_DELAY ticks later, so
+// that replays get the same tables at the same time whether the work was
+// done by the landmark thread or not.  Until then the old tables are
+// used; they may be a little off, which only makes paths a little worse.
+
+const int NUM_LANDMARKS = 6;
+
+class Landmarks
+{
+  public:
+    Landmarks();
+    ~Landmarks();
+
+    // Called at the start of each planning batch, with no searches going
+    void update( Map& map );
+
+    // For the path benchmark, which doesn't run the simulation: make
+    // tables for the current step costs right away, or stop using them
+    void build_now( Map& map );
+    void forget();
+
+    // A lower bound on the cost from a to b, or 0 if there are no tables
+    int lower_bound( const HexCoord& a, const HexCoord& b ) const
+    {
+        int best = 0;
+        for( int i = 0; i < num_tables; ++i )
+        {
+            int da = (*dist[i])[a], db = (*dist[i])[b];
+            if( da < UNREACHABLE && db < UNREACHABLE && db - da > best )
+                best = db - da;
+        }
+        return best;
+    }
+
+    int div;                    // path_div the tables are for, or -1
+    int refreshes;              // statistics
+
+    int landmark_thread( int );
+
+    enum { UNREACHABLE = 0x3fffffff };
+
+  private:
+    int num_tables;             // 0 until the first tables are made
+    MapArray<int>* dist[NUM_LANDMARKS];
+
+    // The copy being worked on
+    EventSem ready;
+    EventSem finished;
+    volatile bool running;
+    volatile bool busy;
+    bool pending;               // staging has a copy not yet in use
+    bool handed_off;            // the landmark thread is working on it
+    long due;                   // tick when the new tables go into use
+    long copied;                // tick when the copy was made
+    long version;               // sum of cost_version_ for the tables
+    long staging_version;
+    int staging_div;
+    MapArray<EdgeCosts>* staging;
+    MapArray<int>* staging_dist[NUM_LANDMARKS];
+
+    void compute();
+};
+
+extern Landmarks landmarks;
+
+#endif
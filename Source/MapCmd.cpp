@@ -14,11 +14,19 @@
 
 #include "Map.h"
 #include "MapCmd.h"
-// #include "Map_const.h"
+#include "Map_Const.h"
 
 #include "Path.h"
+#include "Replay.h"
+#include "Rewind.h"
 
 CommandQueue map_commands;
+
+// Commands that the simulation has taken from map_commands but not yet
+// processed (including postponed ones).  Keeping these separate from
+// map_commands means the replay log sees each command exactly once,
+// at the tick the simulation first saw it.
+static CommandQueue pending_commands;
 inline int MAX_BUILDERS( Map* map )
 {
     // One builder, plus another for each 100,000 in population
@@ -41,12 +49,43 @@ Command CommandQueue::pop()
     return cmd;
 }
 
+// The options can be flipped, and the view scrolled, from the UI thread
+// at any moment.  The simulation works from a copy taken at the start of
+// each tick, and the replay log records the copy, so that a replay uses
+// the same settings on the same ticks.
+void Map::take_options()
+{
+    sleeping_ = sector_sleeping;
+    lod_on_ = level_of_detail;
+    lod_left_ = view_left_;
+    lod_bottom_ = view_bottom_;
+    lod_right_ = view_right_;
+    lod_top_ = view_top_;
+    reserving_ = path_reservations;
+    replay_log.options( time_tick_, sleeping_, lod_on_, reserving_ );
+    if( lod_on_ )
+        replay_log.view_area( time_tick_, lod_left_, lod_bottom_,
+                              lod_right_, lod_top_ );
+}
+
 void Map::process_commands()
 {
-    int commands_processed = 0;
-    while( !map_commands.empty() && commands_processed++ < 5 )
+    take_options();
+
+    // Take the newly issued commands, recording them on the way
+    while( !map_commands.empty() )
     {
         Command c = map_commands.pop();
+        replay_log.record( time_tick_, c );
+        pending_commands.push( c );
+    }
+    
+    int commands_processed = 0;
+    while( !pending_commands.empty() && commands_processed++ < 5 )
+    {
+        Command c = pending_commands.pop();
+        if( valid( c.location ) )
+            wake( c.location );
         switch( c.type )
         {
           case Command::MakeRoads:
@@ -108,12 +147,19 @@ void Map::process_commands()
               break;
           }
 
+          case Command::Rewind:
+          {
+              if( !rewind_buffer.restore( *this, time_tick_ - TICKS_PER_DAY ) )
+                  DosBeep(100,100);
+              break;
+          }
+
           case Command::CreateBlob:
           {
-              if( occupied_[city_center_] >= 0 )
+              if( !has_room( city_center_ ) )
               {
                   // We should wait a while
-                  map_commands.push(c);
+                  pending_commands.push(c);
                   break;
               }
 
@@ -128,15 +174,15 @@ void Map::process_commands()
               Unit* u = NULL;
               bool postpone = false;
               // Try to find an idle soldier
-              for( vector<Unit*>::iterator j = units.begin();
-                   j != units.end(); ++j )
+              for( vector<Unit*>::iterator j = live_units.begin();
+                   j != live_units.end(); ++j )
               {
                   Unit* unit = *j;
                   if( unit->dead() ) continue;
                   if( unit->type == Unit::Builder )
                   {
                       // This is a builder
-                      if( !unit->moving() )
+                      if( !unit->moving() && !unit->planning() )
                       {
                           // It's not doing anything
                           if( !u ) u = unit;
@@ -216,7 +262,7 @@ void Map::process_commands()
                   if( k >= MAX_CMDS*5 )
                   {
                       // We can't fit any more commands now
-                      map_commands.push(c);
+                      pending_commands.push(c);
                       continue;
                   }
                   jobs.push_back( Job() );
@@ -235,15 +281,15 @@ void Map::process_commands()
               {
                   // Count the number of builders
                   int num_builders = 0;
-                  for( vector<Unit*>::iterator j = units.begin();
-                       j != units.end(); ++j )
+                  for( vector<Unit*>::iterator j = live_units.begin();
+                       j != live_units.end(); ++j )
                       if( !(*j)->dead() &&
                           (*j)->type == Unit::Builder )
                           num_builders++;
 
                   // If there aren't too many builders, make one
                   if( num_builders < MAX_BUILDERS(this) &&
-                      occupied_[city_center_] == -1 )
+                      has_room( city_center_ ) )
                       u = Unit::make( this, Unit::Builder, city_center_ );
                   else
                       postpone = true;
@@ -17,11 +17,12 @@
 
 struct Command
 {
-    enum Type { None, SetTerrain, CreateBlob, MakeRoads, EraseAll } type;
+    enum Type { None, SetTerrain, CreateBlob, MakeRoads, EraseAll,
+                Rewind } type;
     HexCoord location;
     Terrain terrain;
 
-    Command():type(None) {}
+    Command():type(None), terrain(Clear) {}
 
     static Command build( Terrain t, const HexCoord& h )
     {
@@ -53,6 +54,14 @@ struct Command
         c.type = EraseAll;
         return c;
     }
+
+    // Go back one day (see Rewind.h)
+    static Command rewind()
+    {
+        Command c;
+        c.type = Rewind;
+        return c;
+    }
 };
 
 class CommandQueue
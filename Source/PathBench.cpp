@@ -0,0 +1,406 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Landmarks.h"
+#include "PathGraph.h"
+
+#include <algo.h>
+
+// Each query is run this many times, so that the clock has something
+// to measure
+const int BENCH_REPEAT = 20;
+
+// A new corpus has the long routes below plus this many random ones
+const int BENCH_RANDOM_QUERIES = 64;
+
+const char* const default_corpus = "pathbench.txt";
+
+// Long routes: corner to corner, and across the middle of each side
+struct BenchRoute
+{
+    int m1, n1, m2, n2;
+};
+
+static const BenchRoute bench_routes[] =
+{
+    { 2, 2, Map::MSize-1, Map::NSize-1 },
+    { Map::MSize-1, Map::NSize-1, 2, 2 },
+    { 2, Map::NSize-1, Map::MSize-1, 2 },
+    { Map::MSize-1, 2, 2, Map::NSize-1 },
+    { 2, Map::NSize/2, Map::MSize-1, Map::NSize/2 },
+    { Map::MSize-1, Map::NSize/2, 2, Map::NSize/2 },
+    { Map::MSize/2, 2, Map::MSize/2, Map::NSize-1 },
+    { Map::MSize/2, Map::NSize-1, Map::MSize/2, 2 },
+};
+const int NUM_BENCH_ROUTES = sizeof(bench_routes)/sizeof(bench_routes[0]);
+
+// The variants of unit A* that are compared.  The path_div values are
+// the ones on the Paths menu.  Building paths don't depend on either
+// setting, so they are only run once per map.
+struct BenchVariant
+{
+    const char* name;
+    int div;
+    bool use_landmarks;
+};
+
+static const BenchVariant bench_variants[] =
+{
+    { "best", 8, false },
+    { "approx1", 6, false },
+    { "approx2", 4, false },
+    { "approx3", 3, false },
+    { "best+landmarks", 8, true },
+    { "approx1+landmarks", 6, true },
+};
+const int NUM_BENCH_VARIANTS =
+    sizeof(bench_variants)/sizeof(bench_variants[0]);
+
+// A query is a path request on the world made from a seed.  A corpus is
+// kept in a text file, so that every variant (and every version of the
+// program) can be run on the same queries:
+//     seed <seed>
+//     unit <m1> <n1> <m2> <n2>
+//     build <m1> <n1> <m2> <n2>
+// A seed line applies to the queries after it.
+struct BenchQuery
+{
+    unsigned long seed;
+    bool build;
+    HexCoord A, B;
+};
+
+static void make_corpus( unsigned long seed, vector<BenchQuery>& corpus )
+{
+    BenchQuery q;
+    q.seed = seed;
+    for( int r = 0; r < NUM_BENCH_ROUTES; r++ )
+    {
+        q.A = HexCoord( bench_routes[r].m1, bench_routes[r].n1 );
+        q.B = HexCoord( bench_routes[r].m2, bench_routes[r].n2 );
+        q.build = false;
+        corpus.push_back( q );
+        q.build = true;
+        corpus.push_back( q );
+    }
+
+    // The random number generator was seeded by the map, so the same
+    // seed always gives the same queries
+    for( int i = 0; i < BENCH_RANDOM_QUERIES; i++ )
+    {
+        q.A = HexCoord( 2 + ShortRandom(Map::MSize-2),
+                        2 + ShortRandom(Map::NSize-2) );
+        q.B = HexCoord( 2 + ShortRandom(Map::MSize-2),
+                        2 + ShortRandom(Map::NSize-2) );
+        q.build = ( i % 4 == 3 );
+        corpus.push_back( q );
+    }
+}
+
+static bool load_corpus( const char* filename, vector<BenchQuery>& corpus )
+{
+    FILE* f = fopen( filename, "rt" );
+    if( !f )
+        return false;
+
+    BenchQuery q;
+    q.seed = 1;
+    char s[256], kind[16];
+    while( fgets( s, 256, f ) )
+    {
+        int m1, n1, m2, n2;
+        if( s[0] == '#' )
+            continue;
+        if( sscanf( s, "seed %lu", &q.seed ) == 1 )
+            continue;
+        if( sscanf( s, "%15s %d %d %d %d", kind, &m1, &n1, &m2, &n2 ) != 5 )
+            continue;
+        q.build = !stricmp( kind, "build" );
+        q.A = HexCoord( m1, n1 );
+        q.B = HexCoord( m2, n2 );
+        if( !Map::valid( q.A ) || !Map::valid( q.B ) )
+            continue;
+        corpus.push_back( q );
+    }
+    fclose( f );
+    return !corpus.empty();
+}
+
+static void save_corpus( const char* filename,
+                         const vector<BenchQuery>& corpus )
+{
+    FILE* f = fopen( filename, "wt" );
+    if( !f )
+        return;
+    fprintf( f, "# SimBlob path benchmark queries\n" );
+    unsigned long seed = 0;
+    for( int i = 0; i < corpus.size(); i++ )
+    {
+        const BenchQuery& q = corpus[i];
+        if( i == 0 || q.seed != seed )
+            fprintf( f, "seed %lu\n", q.seed );
+        seed = q.seed;
+        fprintf( f, "%s %d %d %d %d\n", q.build? "build" : "unit",
+                 q.A.m, q.A.n, q.B.m, q.B.n );
+    }
+    fclose( f );
+}
+
+struct BenchProgress
+{
+    bool message( const char* text )
+    {
+        Log( "PathBench", text );
+        return false;
+    }
+};
+
+struct BenchNode
+{
+    HexCoord loc;
+    int g;
+    BenchNode( const HexCoord& h, int g_ ): loc(h), g(g_) {}
+    BenchNode(): loc(), g(0) {}
+};
+
+inline bool operator > ( const BenchNode& a, const BenchNode& b )
+{
+    return a.g > b.g;
+}
+
+// The cost of the best path from A to B at full accuracy (path_div 8),
+// with Dijkstra's algorithm, or -1 if there is none.  Paths found with
+// any variant are measured against this.
+static int best_cost( Map& map, MapArray<int>& cost,
+                      const HexCoord& A, const HexCoord& B )
+{
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+            cost[HexCoord(m,n)] = MAXIMUM_PATH_LENGTH;
+
+    greater<BenchNode> comp;
+    vector<BenchNode> open;
+    cost[A] = 0;
+    open.push_back( BenchNode(A,0) );
+    while( !open.empty() )
+    {
+        pop_heap( open.begin(), open.end(), comp );
+        BenchNode N = open.back();
+        open.pop_back();
+        if( N.loc == B )
+            return N.g;
+        if( N.g > cost[N.loc] )
+            continue;
+
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord h2 = Neighbor( N.loc, HexDirection(d) );
+            if( !map.valid(h2) )
+                continue;
+            int k = movement_cost( map, N.loc, h2, NULL );
+            if( k >= MAXIMUM_PATH_LENGTH )
+                continue;
+            if( N.g + k < cost[h2] )
+            {
+                cost[h2] = N.g + k;
+                open.push_back( BenchNode(h2,N.g+k) );
+                push_heap( open.begin(), open.end(), comp );
+            }
+        }
+    }
+    return -1;
+}
+
+// The cost of a path (stored backwards) at full accuracy
+static int full_cost( Map& map, const vector<HexCoord>& path )
+{
+    int total = 0;
+    for( int i = path.size()-1; i > 0; i-- )
+        total += movement_cost( map, path[i], path[i-1], NULL );
+    return total;
+}
+
+// Everything measured for one variant over the corpus
+struct BenchResults
+{
+    vector<double> ms;          // latency of each query
+    double expanded;            // nodes removed from OPEN
+    double visited;
+    int found;
+    int optimal;
+    double total_gap;           // in percent
+    double worst_gap;
+
+    BenchResults(): expanded(0.0), visited(0.0), found(0), optimal(0),
+                    total_gap(0.0), worst_gap(0.0) {}
+
+    double percentile( vector<double>& sorted, int p ) const
+    {
+        if( sorted.empty() ) return 0.0;
+        int i = ( sorted.size()-1 ) * p / 100;
+        return sorted[i];
+    }
+
+    void log( const char* name )
+    {
+        vector<double> sorted( ms );
+        sort( sorted.begin(), sorted.end() );
+        int n = ms.size();
+        char s[256];
+        sprintf( s, "%-18s %3d queries: %8.3f ms p50, %8.3f p90, "
+                 "%8.3f p99, %8.3f max; %7.0f expanded, %7.0f visited "
+                 "per query", name, n,
+                 percentile( sorted, 50 ), percentile( sorted, 90 ),
+                 percentile( sorted, 99 ), percentile( sorted, 100 ),
+                 n? expanded/n : 0.0, n? visited/n : 0.0 );
+        Log( "PathBench", s );
+        if( found > 0 )
+        {
+            sprintf( s, "%-18s %3d paths, %3d optimal, cost %5.2f%% over "
+                     "the best on average, %6.2f%% worst", name, found,
+                     optimal, total_gap/found, worst_gap );
+            Log( "PathBench", s );
+        }
+    }
+};
+
+// Run every query for one world, adding to the results
+static void run_queries( Map& map, const vector<BenchQuery>& corpus,
+                         int first, int last,
+                         BenchResults* unit_results,
+                         BenchResults& build_results )
+{
+    int saved_div = path_div;
+    MapArray<int>* cost = new MapArray<int>( MAXIMUM_PATH_LENGTH );
+
+    // The sector graph still has the last world's costs
+    path_graph.forget();
+
+    // The best costs don't depend on the variant
+    vector<int> best;
+    for( int i = first; i < last; i++ )
+    {
+        const BenchQuery& q = corpus[i];
+        best.push_back( q.build? -1 : best_cost( map, *cost, q.A, q.B ) );
+    }
+
+    for( int v = -1; v < NUM_BENCH_VARIANTS; v++ )
+    {
+        // Variant -1 is for the building paths
+        bool build = ( v < 0 );
+        BenchResults& results = build? build_results : unit_results[v];
+        if( !build )
+        {
+            path_div = bench_variants[v].div;
+            prepare_edge_costs( map );
+            if( bench_variants[v].use_landmarks )
+                landmarks.build_now( map );
+            else
+                landmarks.forget();
+        }
+
+        for( int i = first; i < last; i++ )
+        {
+            const BenchQuery& q = corpus[i];
+            if( q.build != build )
+                continue;
+
+            vector<HexCoord> path;
+            PathStats stats;
+            clock_t c0 = clock();
+            for( int r = 0; r < BENCH_REPEAT; r++ )
+            {
+                path.erase( path.begin(), path.end() );
+                stats = build? FindBuildPath( map, q.A, q.B, path )
+                    : FindUnitPath( map, q.A, q.B, path, NULL );
+            }
+            clock_t c1 = clock();
+
+            results.ms.push_back( 1000.0*double(c1-c0)/CLK_TCK/BENCH_REPEAT );
+            results.expanded += stats.nodes_removed;
+            results.visited += stats.nodes_visited;
+
+            // The unit path may end next to B if B can't be entered, so
+            // compare it with the best way to wherever it does end
+            int b = best[i-first];
+            if( build || path.empty() || b < 0 )
+                continue;
+            if( path[0] != q.B )
+                b = best_cost( map, *cost, q.A, path[0] );
+            if( b <= 0 )
+                continue;
+            double gap = 100.0 * ( full_cost( map, path ) - b ) / b;
+            results.found++;
+            if( gap <= 0.0 ) results.optimal++;
+            results.total_gap += gap;
+            if( gap > results.worst_gap ) results.worst_gap = gap;
+        }
+    }
+
+    delete cost;
+    landmarks.forget();
+    path_div = saved_div;
+    prepare_edge_costs( map );
+}
+
+void PathBenchmark( const char* filename, unsigned long seed )
+{
+    vector<BenchQuery> corpus;
+    if( filename == NULL || !load_corpus( filename, corpus ) )
+    {
+        // Make a new corpus from the seed, and save it so that later
+        // runs use the same queries
+        Map* map = new Map( seed );
+        BenchProgress progress;
+        map->initialize( closure( &progress, &BenchProgress::message ) );
+        make_corpus( seed, corpus );
+        delete map;
+        save_corpus( filename? filename : default_corpus, corpus );
+    }
+
+    BenchResults unit_results[NUM_BENCH_VARIANTS];
+    BenchResults build_results;
+    clock_t c0 = clock();
+    int num_worlds = 0;
+    int first = 0;
+    while( first < corpus.size() )
+    {
+        // The queries for one world are together
+        int last = first;
+        while( last < corpus.size() && corpus[last].seed == corpus[first].seed )
+            last++;
+
+        Map* map = new Map( corpus[first].seed );
+        BenchProgress progress;
+        map->initialize( closure( &progress, &BenchProgress::message ) );
+        run_queries( *map, corpus, first, last, unit_results, build_results );
+        delete map;
+
+        num_worlds++;
+        first = last;
+    }
+    clock_t c1 = clock();
+
+    char s[256];
+    sprintf( s, "%d queries on %d worlds, %d variants x %d runs each: "
+             "%7.3f seconds", int(corpus.size()), num_worlds,
+             NUM_BENCH_VARIANTS, BENCH_REPEAT, double(c1-c0)/CLK_TCK );
+    Log( "PathBench", s );
+    for( int v = 0; v < NUM_BENCH_VARIANTS; v++ )
+        unit_results[v].log( bench_variants[v].name );
+    build_results.log( "build" );
+}
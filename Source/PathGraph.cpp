@@ -0,0 +1,312 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "PathGraph.h"
+
+#include <algo.h>
+
+const int PORTAL_SPACING = 5;
+const int UNREACHED = MAXIMUM_PATH_LENGTH;
+
+PathGraph path_graph;
+
+// Position of a hex within its sector, in SectorIterator order
+inline int local_index( const HexCoord& origin, const HexCoord& h )
+{
+    return ( h.m - origin.m ) + ( h.n - origin.n ) * SECTOR_X_SIZE;
+}
+
+struct LocalNode
+{
+    HexCoord loc;
+    int g;
+    LocalNode( const HexCoord& h, int g_ ): loc(h), g(g_) {}
+    LocalNode(): loc(), g(0) {}
+};
+
+inline bool operator > ( const LocalNode& a, const LocalNode& b )
+{
+    return a.g > b.g;
+}
+
+// Dijkstra's algorithm, staying inside one sector.  Fills in the cost
+// from start to every hex in the sector, or (if reverse is set) the cost
+// from every hex in the sector to start.
+static void sector_costs( Map& map, int s, const HexCoord& start,
+                          bool reverse, int* cost )
+{
+    HexCoord origin = sector_origin( s );
+    for( int i = 0; i < HEXES_IN_SECTOR; ++i )
+        cost[i] = UNREACHED;
+
+    greater<LocalNode> comp;
+    vector<LocalNode> open;
+    open.reserve( HEXES_IN_SECTOR );
+    cost[local_index(origin,start)] = 0;
+    open.push_back( LocalNode(start,0) );
+    while( !open.empty() )
+    {
+        pop_heap( open.begin(), open.end(), comp );
+        LocalNode N = open.back();
+        open.pop_back();
+        if( N.g > cost[local_index(origin,N.loc)] )
+            continue;           // there was a better way here
+
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord h2 = Neighbor( N.loc, HexDirection(d) );
+            if( !map.valid(h2) || sector(h2) != s )
+                continue;
+            int k = reverse?
+                static_movement_cost( map, h2, HexDirection( (d+3) % 6 ) )
+                : static_movement_cost( map, N.loc, HexDirection(d) );
+            int g = N.g + k;
+            int& c = cost[local_index(origin,h2)];
+            if( g < c )
+            {
+                c = g;
+                open.push_back( LocalNode(h2,g) );
+                push_heap( open.begin(), open.end(), comp );
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+PathGraph::PathGraph()
+    :built(false)
+{
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        version[s] = -1;
+        version_div[s] = -1;
+    }
+}
+
+int PathGraph::node_at( const HexCoord& h )
+{
+    int s = sector(h);
+    for( int i = 0; i < sector_nodes[s].size(); ++i )
+        if( nodes[sector_nodes[s][i]].loc == h )
+            return sector_nodes[s][i];
+
+    PortalNode N;
+    N.loc = h;
+    N.sector = s;
+    N.slot = sector_nodes[s].size();
+    nodes.push_back( N );
+    sector_nodes[s].push_back( nodes.size()-1 );
+    return nodes.size()-1;
+}
+
+void PathGraph::link( const HexCoord& a, const HexCoord& b )
+{
+    int i = node_at( a );
+    int j = node_at( b );
+    vector<int>& links = nodes[i].links;
+    for( int k = 0; k < links.size(); ++k )
+        if( links[k] == j ) return;
+    links.push_back( j );
+    nodes[j].links.push_back( i );
+}
+
+void PathGraph::build( Map& map )
+{
+    // Portals are placed along the far side (higher m, higher n) of
+    // each sector, so that each border is only visited once.  A hex on
+    // the border is linked to every neighbor in another sector.
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        HexCoord o = sector_origin( s );
+        HexCoord far( o.m+SECTOR_X_SIZE-1, o.n+SECTOR_Y_SIZE-1 );
+        vector<HexCoord> candidates;
+        for( int n = o.n + PORTAL_SPACING/2; n <= far.n; n += PORTAL_SPACING )
+            candidates.push_back( HexCoord( far.m, n ) );
+        for( int m = o.m + PORTAL_SPACING/2; m <= far.m; m += PORTAL_SPACING )
+            candidates.push_back( HexCoord( m, far.n ) );
+        candidates.push_back( far );
+
+        for( int c = 0; c < candidates.size(); ++c )
+        {
+            HexCoord a = candidates[c];
+            if( !map.valid(a) ) continue;
+            for( int d = 0; d < 6; ++d )
+            {
+                HexCoord b = Neighbor( a, HexDirection(d) );
+                if( map.valid(b) && sector(b) != s )
+                    link( a, b );
+            }
+        }
+    }
+    built = true;
+}
+
+void PathGraph::forget()
+{
+    // The portals depend only on where the sectors are, so they stay
+    Mutex::Lock lock( mutex );
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        version[s] = -1;
+        version_div[s] = -1;
+    }
+}
+
+void PathGraph::refresh( Map& map, int s )
+{
+    int div = path_div;
+    if( version[s] == map.cost_version_[s] && version_div[s] == div )
+        return;
+
+    HexCoord origin = sector_origin( s );
+    int num = sector_nodes[s].size();
+    vector<int>& costs = intra[s];
+    costs.erase( costs.begin(), costs.end() );
+    costs.insert( costs.end(), num*num, UNREACHED );
+
+    int cost[HEXES_IN_SECTOR];
+    for( int i = 0; i < num; ++i )
+    {
+        sector_costs( map, s, nodes[sector_nodes[s][i]].loc, false, cost );
+        for( int j = 0; j < num; ++j )
+            costs[i*num+j] =
+                cost[local_index(origin, nodes[sector_nodes[s][j]].loc)];
+    }
+
+    version[s] = map.cost_version_[s];
+    version_div[s] = div;
+}
+
+//////////////////////////////////////////////////////////////////////
+// A* over the portal graph.  The start and goal are not nodes; instead
+// the search starts at every portal of A's sector (with the cost from A)
+// and any portal of B's sector can finish it (with the cost to B).
+
+struct GraphEntry
+{
+    int f;
+    int node;
+    GraphEntry( int f_, int node_ ): f(f_), node(node_) {}
+    GraphEntry(): f(0), node(0) {}
+};
+
+inline bool operator > ( const GraphEntry& a, const GraphEntry& b )
+{
+    return a.f > b.f;
+}
+
+bool PathGraph::find_path( Map& map, const HexCoord& A, const HexCoord& B,
+                           vector<HexCoord>& waypoints )
+{
+    int sA = sector(A), sB = sector(B);
+    if( sA == sB )
+        return false;
+
+    Mutex::Lock lock( mutex );
+    if( !built ) build( map );
+
+    int from_A[HEXES_IN_SECTOR], to_B[HEXES_IN_SECTOR];
+    sector_costs( map, sA, A, false, from_A );
+    sector_costs( map, sB, B, true, to_B );
+
+    int num = nodes.size();
+    int goal = num;             // stands for B
+    vector<int> g( num+1, UNREACHED );
+    vector<int> parent( num+1, -1 );
+    vector<bool> closed( num+1, false );
+    greater<GraphEntry> comp;
+    vector<GraphEntry> open;
+
+    HexCoord oA = sector_origin( sA ), oB = sector_origin( sB );
+    for( int i = 0; i < sector_nodes[sA].size(); ++i )
+    {
+        int n = sector_nodes[sA][i];
+        int c = from_A[local_index(oA, nodes[n].loc)];
+        if( c >= UNREACHED ) continue;
+        g[n] = c;
+        open.push_back( GraphEntry( c + hex_distance(nodes[n].loc,B), n ) );
+        push_heap( open.begin(), open.end(), comp );
+    }
+
+    while( !open.empty() )
+    {
+        pop_heap( open.begin(), open.end(), comp );
+        int i = open.back().node;
+        open.pop_back();
+        if( closed[i] ) continue;
+        closed[i] = true;
+        if( i == goal ) break;
+
+        const PortalNode& N = nodes[i];
+        vector<int> next, step;
+
+        // The goal, from a portal in its sector
+        if( N.sector == sB )
+        {
+            next.push_back( goal );
+            step.push_back( to_B[local_index(oB, N.loc)] );
+        }
+
+        // The other portals of this sector
+        refresh( map, N.sector );
+        const vector<int>& costs = intra[N.sector];
+        int count = sector_nodes[N.sector].size();
+        for( int j = 0; j < count; ++j )
+            if( j != N.slot )
+            {
+                next.push_back( sector_nodes[N.sector][j] );
+                step.push_back( costs[N.slot*count+j] );
+            }
+
+        // Across the border
+        for( int k = 0; k < N.links.size(); ++k )
+        {
+            next.push_back( N.links[k] );
+            step.push_back( static_movement_cost( map, N.loc,
+                                                  nodes[N.links[k]].loc ) );
+        }
+
+        for( int k = 0; k < next.size(); ++k )
+        {
+            int j = next[k];
+            if( closed[j] || step[k] >= UNREACHED ) continue;
+            int new_g = g[i] + step[k];
+            if( new_g < g[j] )
+            {
+                g[j] = new_g;
+                parent[j] = i;
+                int h = ( j == goal )? 0 : hex_distance( nodes[j].loc, B );
+                open.push_back( GraphEntry( new_g + h, j ) );
+                push_heap( open.begin(), open.end(), comp );
+            }
+        }
+    }
+
+    if( !closed[goal] )
+        return false;
+
+    // Walk back from the goal, then put the portals in order
+    vector<HexCoord> reversed;
+    for( int i = parent[goal]; i != -1; i = parent[i] )
+        reversed.push_back( nodes[i].loc );
+    while( !reversed.empty() )
+    {
+        waypoints.push_back( reversed.back() );
+        reversed.pop_back();
+    }
+    return true;
+}
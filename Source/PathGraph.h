@@ -0,0 +1,69 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#ifndef PathGraph_h
+#define PathGraph_h
+
+// The sector graph is used to plan long paths.  Along every border
+// between two sectors there are portals: pairs of neighboring hexes, one
+// on each side, every PORTAL_SPACING hexes.  Each sector caches the cost
+// of moving between each pair of its portal hexes without leaving the
+// sector; the cache is rebuilt when the sector's cost_version_ changes.
+// A long path is planned by searching this graph (a few hundred nodes)
+// and then finding the detailed path from each portal to the next with
+// ordinary A*, which only has to look at a sector or two at a time.
+//
+// The cached costs ignore blobs, since they move every tick.  The
+// detailed paths do take them into account.
+
+struct PortalNode
+{
+    HexCoord loc;
+    int sector;
+    int slot;                   // position in the sector's list of nodes
+    vector<int> links;          // nodes just across the border
+};
+
+class PathGraph
+{
+  public:
+    PathGraph();
+    ~PathGraph() {}
+
+    // Fill in the portal hexes to go through, in order, on the way from
+    // A to B (not including A or B).  Returns false if A and B are in
+    // the same sector, or if there's no way through.
+    bool find_path( Map& map, const HexCoord& A, const HexCoord& B,
+                    vector<HexCoord>& waypoints );
+
+    // Throw out the cached costs, which are only good for the Map they
+    // were made from (its cost_version_ counts start over)
+    void forget();
+
+  private:
+    Mutex mutex;
+    bool built;
+    vector<PortalNode> nodes;
+    vector<int> sector_nodes[NUM_SECTORS];
+    vector<int> intra[NUM_SECTORS];     // costs between a sector's nodes
+    long version[NUM_SECTORS];          // cost_version_ when intra was made
+    int version_div[NUM_SECTORS];       // path_div when intra was made
+
+    void build( Map& map );
+    int node_at( const HexCoord& h );
+    void link( const HexCoord& a, const HexCoord& b );
+    void refresh( Map& map, int s );
+};
+
+extern PathGraph path_graph;
+
+#endif
@@ -0,0 +1,206 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Unit.h"
+#include "FlowField.h"
+#include "Replan.h"
+#include "Landmarks.h"
+#include "PathPlanner.h"
+
+PathPlanner path_planner;
+
+// Upper limits (in milliseconds) of the wait buckets; the last is open
+static const int wait_limits[PLAN_WAIT_BUCKETS-1] = { 1, 4, 16, 64, 256 };
+
+PathPlanner::PathPlanner()
+    :running(false), working(false), next_ticket(1),
+     next_search(0), batch_map(NULL),
+     ticks_planned(0), paths_planned(0), total_time(0), worst_time(0)
+{
+    for( int i = 0; i < PLAN_WAIT_BUCKETS; ++i )
+        waits[i] = 0;
+}
+
+PathPlanner::~PathPlanner()
+{
+    for( int i = 0; i < posted.size(); ++i )
+        delete posted[i];
+    for( int i = 0; i < solved.size(); ++i )
+        delete solved[i];
+}
+
+long PathPlanner::post( Unit* unit, const HexCoord& A, const HexCoord& B,
+                        int cutoff, bool shared, bool replan )
+{
+    PathRequest* r = new PathRequest;
+    r->unit = unit;
+    r->A = A;
+    r->B = B;
+    r->cutoff = cutoff;
+    r->shared = shared;
+    r->replan = replan;
+    r->posted = clock();
+
+    Mutex::Lock lock( mutex );
+    r->ticket = next_ticket++;
+    posted.push_back( r );
+    return r->ticket;
+}
+
+void PathPlanner::deliver( Map& map )
+{
+    // Blobs that died or changed their minds since posting have a
+    // different ticket (or none), so their answers are dropped
+    for( int i = 0; i < solved.size(); ++i )
+    {
+        PathRequest* r = solved[i];
+        if( !r->unit->dead() && r->unit->plan_ticket == r->ticket )
+            r->unit->receive_path( &map, *r );
+        delete r;
+    }
+    solved.erase( solved.begin(), solved.end() );
+}
+
+void PathPlanner::solve( Map& map, PathRequest* r )
+{
+    if( r->shared && flow_fields.find_path( map, r->A, r->B, r->path ) )
+        return;
+    if( r->replan && replanner.find_path( map, r->unit, r->A, r->B,
+                                          r->cutoff, r->path ) )
+        return;
+    FindUnitPath( map, r->A, r->B, r->path, r->unit, r->cutoff );
+}
+
+void PathPlanner::search_some( Map& map )
+{
+    for(;;)
+    {
+        int i;
+        {
+            Mutex::Lock lock( mutex );
+            i = next_search++;
+        }
+        if( i >= searches.size() )
+            break;
+        solve( map, searches[i] );
+    }
+}
+
+void PathPlanner::plan( Map& map )
+{
+    vector<PathRequest*> batch;
+    {
+        Mutex::Lock lock( mutex );
+        batch.swap( posted );
+    }
+
+    // The landmark tables change on fixed ticks, even with nothing to plan
+    prepare_edge_costs( map );
+    landmarks.update( map );
+    if( batch.empty() )
+        return;
+
+    clock_t c0 = clock();
+    searches.erase( searches.begin(), searches.end() );
+    for( int i = 0; i < batch.size(); ++i )
+        if( !batch[i]->shared && !batch[i]->replan )
+            searches.push_back( batch[i] );
+    next_search = 0;
+
+    // Start the planner thread on the searches, unless there's only one
+    bool helped = running && searches.size() > 1;
+    if( helped )
+    {
+        batch_map = &map;
+        finished.reset();
+        working = true;
+        start.post();
+    }
+
+    for( int i = 0; i < batch.size(); ++i )
+        if( batch[i]->shared || batch[i]->replan )
+            solve( map, batch[i] );
+    search_some( map );
+
+    while( helped && working )
+        finished.wait( 100 );
+
+    clock_t c1 = clock();
+    for( int i = 0; i < batch.size(); ++i )
+    {
+        long ms = long( c1 - batch[i]->posted ) * 1000 / CLK_TCK;
+        int b = 0;
+        while( b < PLAN_WAIT_BUCKETS-1 && ms >= wait_limits[b] )
+            ++b;
+        waits[b]++;
+        solved.push_back( batch[i] );
+    }
+
+    ticks_planned++;
+    paths_planned += batch.size();
+    total_time += c1 - c0;
+    if( c1 - c0 > worst_time )
+        worst_time = c1 - c0;
+}
+
+int PathPlanner::planner_thread( int )
+{
+    running = true;
+    while( running )
+    {
+        if( !start.wait( 500 ) )
+            continue;
+        start.reset();
+        if( working )
+        {
+            search_some( *batch_map );
+            working = false;
+            finished.post();
+        }
+    }
+    return 0;
+}
+
+void PathPlanner::report()
+{
+    if( ticks_planned == 0 )
+        return;
+
+    char s[256];
+    sprintf( s, "%ld paths in %ld ticks: %7.3f ms per tick, worst %7.3f ms",
+             paths_planned, ticks_planned,
+             1000.0 * total_time / CLK_TCK / ticks_planned,
+             1000.0 * worst_time / CLK_TCK );
+    Log( "Planner", s );
+    sprintf( s, "Waits: %ld under 1 ms, %ld under 4, %ld under 16, "
+             "%ld under 64, %ld under 256, %ld longer",
+             waits[0], waits[1], waits[2], waits[3], waits[4], waits[5] );
+    Log( "Planner", s );
+    sprintf( s, "Blocked blobs: %d new searches, %d repaired, %ld nodes",
+             replanner.searches, replanner.repairs, replanner.expanded );
+    Log( "Planner", s );
+    sprintf( s, "Landmark tables refreshed %d times", landmarks.refreshes );
+    Log( "Planner", s );
+
+    ticks_planned = 0;
+    paths_planned = 0;
+    total_time = 0;
+    worst_time = 0;
+    for( int i = 0; i < PLAN_WAIT_BUCKETS; ++i )
+        waits[i] = 0;
+}
@@ -0,0 +1,99 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef PathPlanner_h
+#define PathPlanner_h
+
+// Blobs don't search for paths themselves.  Unit::set_dest and
+// Unit::replan post a request here, and at the end of each tick
+// simulate_military has the planner solve all of the tick's requests.
+// The simulation thread and the planner thread split the A* searches
+// between them.  Blobs pick up their new paths at the start of the next
+// tick; while a request is waiting, the blob stands still.
+//
+// Requests that follow a flow field or repair an old search (Replan.h)
+// are always solved on the simulation thread, in the order they were
+// posted, because what is in those caches depends on that order.  A*
+// searches only read what they share: plan() fills in the step cost
+// cache and the landmark tables before the batch starts, and the sector
+// graph has a lock of its own.  So they can be solved in any order, on
+// either thread.  When there is no planner thread (in a replay, for
+// example), the simulation thread solves everything itself.
+
+struct Unit;
+
+struct PathRequest
+{
+    Unit* unit;
+    long ticket;                // matches unit->plan_ticket while wanted
+    HexCoord A, B;
+    int cutoff;
+    bool shared;                // follow a flow field if possible
+    bool replan;                // repair this blob's last search if possible
+    clock_t posted;
+    vector<HexCoord> path;      // the answer, in reverse order as usual
+};
+
+inline void destroy( PathRequest** ) {}
+
+const int PLAN_WAIT_BUCKETS = 6;
+
+class PathPlanner
+{
+  public:
+    PathPlanner();
+    ~PathPlanner();
+
+    // Ask for a path from A to B.  Returns the ticket for the request.
+    long post( Unit* unit, const HexCoord& A, const HexCoord& B,
+               int cutoff, bool shared, bool replan );
+
+    // Both of these are called by the simulation thread with unit_mutex
+    // held: deliver() hands out the paths solved last tick, and plan()
+    // solves everything posted since.
+    void deliver( Map& map );
+    void plan( Map& map );
+
+    // Write the planning times to the log, and start counting again
+    void report();
+
+    int planner_thread( int );
+
+  private:
+    Mutex mutex;                // protects posted and next_search
+    EventSem start;
+    EventSem finished;
+    volatile bool running;
+    volatile bool working;      // the planner thread has searches to do
+    long next_ticket;
+
+    vector<PathRequest*> posted;    // waiting for plan()
+    vector<PathRequest*> searches;  // A* searches being solved now
+    int next_search;
+    Map* batch_map;
+    vector<PathRequest*> solved;    // waiting for deliver()
+
+    // Statistics since the last report
+    long ticks_planned;
+    long paths_planned;
+    clock_t total_time;
+    clock_t worst_time;
+    long waits[PLAN_WAIT_BUCKETS];  // time from post() to solved
+
+    void solve( Map& map, PathRequest* r );
+    void search_some( Map& map );
+};
+
+extern PathPlanner path_planner;
+
+#endif
@@ -0,0 +1,407 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Unit.h"
+#include "Replan.h"
+
+#include <algo.h>
+
+const int REPLAN_RADIUS = 3;    // in hexes
+const int INFINITE_COST = 0x3fffffff;
+
+Replanner replanner;
+
+struct ReplanEntry
+{
+    int k1, k2;
+    HexCoord loc;
+    ReplanEntry( int k1_, int k2_, const HexCoord& h )
+        : k1(k1_), k2(k2_), loc(h) {}
+    ReplanEntry(): k1(0), k2(0), loc() {}
+};
+
+inline bool operator < ( const ReplanEntry& a, const ReplanEntry& b )
+{
+    return a.k1 < b.k1 || ( a.k1 == b.k1 && a.k2 < b.k2 );
+}
+
+inline bool operator > ( const ReplanEntry& a, const ReplanEntry& b )
+{
+    return b < a;
+}
+
+// The search for one blob.  g and rhs are the costs from each hex to the
+// goal, as in the D* Lite paper; a hex is consistent when they're equal.
+// Entries in the open heap are not removed when a hex's key changes;
+// instead an entry is skipped when it no longer matches its hex.
+struct ReplanState
+{
+    Unit* unit;
+    int unit_id;
+    HexCoord goal;
+    HexCoord start;
+    long last_used;
+    int div;                    // path_div when this search was started
+    int step;                   // the cheapest step, for the heuristic
+    int km;                     // how far the start has moved
+    bool valid;
+    SectorArray<long> versions; // cost_version_ the costs were read at
+
+    MapArray<int> g, rhs;
+    MapArray<byte> blocked;     // blobs that are in the way
+    vector<HexCoord> blockers;
+    vector<HexCoord> touched;   // hexes whose g or rhs isn't infinite
+    vector<ReplanEntry> open;
+
+    ReplanState();
+    ~ReplanState() {}
+
+    bool current( Map& map, Unit* u, const HexCoord& B );
+    void reset( Map& map, Unit* u, const HexCoord& A, const HexCoord& B );
+    void update_costs( Map& map );
+    void update_blockers( Map& map );
+    bool compute( Map& map, int limit, long& expanded );
+    bool extract( Map& map, vector<HexCoord>& path );
+
+    // Roads make the cheapest step 13-div (see UnitMovement::kost)
+    int h( const HexCoord& a, const HexCoord& b )
+    { return hex_distance( a, b ) * step / 10; }
+
+    int cost( Map& map, const HexCoord& a, int d, const HexCoord& b )
+    {
+        return blocked[b]? INFINITE_COST
+            : static_movement_cost( map, a, HexDirection(d) );
+    }
+
+    ReplanEntry key( const HexCoord& s )
+    {
+        int k = min( g[s], rhs[s] );
+        if( k >= INFINITE_COST )
+            return ReplanEntry( INFINITE_COST, INFINITE_COST, s );
+        return ReplanEntry( k + h( start, s ) + km, k, s );
+    }
+
+    void push( const HexCoord& s )
+    {
+        open.push_back( key( s ) );
+        push_heap( open.begin(), open.end(), greater<ReplanEntry>() );
+    }
+
+    void update_vertex( Map& map, const HexCoord& s );
+};
+
+ReplanState::ReplanState()
+    :unit(NULL), unit_id(DEAD_ID), last_used(0), div(-1), step(10), km(0),
+     valid(false), versions(0),
+     g(INFINITE_COST), rhs(INFINITE_COST), blocked(0)
+{
+}
+
+bool ReplanState::current( Map& map, Unit* u, const HexCoord& B )
+{
+    return valid && u == unit && u->id == unit_id && B == goal
+        && div == int(path_div);
+}
+
+void ReplanState::reset( Map& map, Unit* u, const HexCoord& A,
+                         const HexCoord& B )
+{
+    // Only the hexes the last search reached need to be cleared
+    for( int i = 0; i < touched.size(); ++i )
+    {
+        g[touched[i]] = INFINITE_COST;
+        rhs[touched[i]] = INFINITE_COST;
+    }
+    for( int i = 0; i < blockers.size(); ++i )
+        blocked[blockers[i]] = 0;
+    touched.erase( touched.begin(), touched.end() );
+    blockers.erase( blockers.begin(), blockers.end() );
+    open.erase( open.begin(), open.end() );
+
+    unit = u;
+    unit_id = u->id;
+    goal = B;
+    start = A;
+    div = path_div;
+    step = 13 - div;
+    km = 0;
+    valid = true;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        versions[s] = map.cost_version_[s];
+
+    rhs[goal] = 0;
+    touched.push_back( goal );
+    push( goal );
+}
+
+// The terrain costs changed in some sectors since the search last ran.
+// cost_change doesn't say which hexes, so every hex the search has
+// reached in those sectors, or next to them (a step's cost depends on
+// the hex it steps into), gets its rhs worked out again.  This is the
+// edge cost update of D* Lite.
+void ReplanState::update_costs( Map& map )
+{
+    SectorArray<byte> changed( 0 );
+    bool any = false;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        if( versions[s] != map.cost_version_[s] )
+        {
+            versions[s] = map.cost_version_[s];
+            changed[s] = 1;
+            any = true;
+        }
+    if( !any )
+        return;
+
+    // update_vertex can add to touched, but the new hexes already have
+    // the new costs
+    int n = touched.size();
+    for( int i = 0; i < n; ++i )
+    {
+        HexCoord t = touched[i];
+        bool near = changed[sector(t)];
+        for( int d = 0; d < 6 && !near; ++d )
+        {
+            HexCoord t2 = Neighbor( t, HexDirection(d) );
+            near = map.valid(t2) && changed[sector(t2)];
+        }
+        if( near )
+            update_vertex( map, t );
+    }
+}
+
+void ReplanState::update_vertex( Map& map, const HexCoord& s )
+{
+    if( s != goal )
+    {
+        int best = INFINITE_COST;
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord n = Neighbor( s, HexDirection(d) );
+            if( !map.valid(n) || g[n] >= INFINITE_COST )
+                continue;
+            int c = cost( map, s, d, n );
+            if( c < INFINITE_COST && c + g[n] < best )
+                best = c + g[n];
+        }
+        if( best < INFINITE_COST
+            && rhs[s] >= INFINITE_COST && g[s] >= INFINITE_COST )
+            touched.push_back( s );
+        rhs[s] = best;
+    }
+    if( g[s] != rhs[s] )
+        push( s );
+}
+
+void ReplanState::update_blockers( Map& map )
+{
+    // The same test as UnitMovement::kost: blobs that are standing still,
+    // and any blob right next to us
+    vector<HexCoord> now;
+    for( int m = start.m - REPLAN_RADIUS; m <= start.m + REPLAN_RADIUS; ++m )
+        for( int n = start.n - REPLAN_RADIUS; n <= start.n + REPLAN_RADIUS; ++n )
+        {
+            HexCoord hn(m,n);
+            if( !map.valid(hn) || hex_distance( start, hn ) > 10*REPLAN_RADIUS )
+                continue;
+            if( map.blocked( hn, unit, hex_distance( start, hn ) <= 10 ) )
+                now.push_back( hn );
+        }
+
+    // Only the hexes that changed need their neighbors updated, since a
+    // blob only changes the cost of stepping into its hex
+    vector<HexCoord> changed;
+    for( int i = 0; i < blockers.size(); ++i )
+        blocked[blockers[i]] = 2;
+    for( int i = 0; i < now.size(); ++i )
+    {
+        if( blocked[now[i]] == 0 )
+            changed.push_back( now[i] );
+        blocked[now[i]] = 1;
+    }
+    for( int i = 0; i < blockers.size(); ++i )
+        if( blocked[blockers[i]] == 2 )
+        {
+            blocked[blockers[i]] = 0;
+            changed.push_back( blockers[i] );
+        }
+    blockers = now;
+
+    for( int i = 0; i < changed.size(); ++i )
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord s = Neighbor( changed[i], HexDirection(d) );
+            if( map.valid(s) )
+                update_vertex( map, s );
+        }
+}
+
+bool ReplanState::compute( Map& map, int limit, long& expanded )
+{
+    int count = 0;
+    greater<ReplanEntry> comp;
+    while( !open.empty() )
+    {
+        ReplanEntry top = open.front();
+        if( !( top < key(start) ) && rhs[start] == g[start] )
+            break;
+        pop_heap( open.begin(), open.end(), comp );
+        open.pop_back();
+
+        HexCoord u = top.loc;
+        if( g[u] == rhs[u] )
+            continue;           // already consistent
+        ReplanEntry k = key( u );
+        if( top < k )
+        {
+            // The start moved since this entry was made
+            open.push_back( k );
+            push_heap( open.begin(), open.end(), comp );
+            continue;
+        }
+        if( k < top )
+            continue;           // there's a newer entry for this hex
+
+        if( ++count > limit )
+            return false;
+        expanded++;
+
+        if( g[u] > rhs[u] )
+            g[u] = rhs[u];
+        else
+        {
+            g[u] = INFINITE_COST;
+            update_vertex( map, u );
+        }
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord s = Neighbor( u, HexDirection(d) );
+            if( map.valid(s) )
+                update_vertex( map, s );
+        }
+    }
+    return g[start] < INFINITE_COST;
+}
+
+bool ReplanState::extract( Map& map, vector<HexCoord>& path )
+{
+    // Walk downhill from the start
+    vector<HexCoord> forward;
+    HexCoord s = start;
+    forward.push_back( s );
+    while( s != goal )
+    {
+        int best = INFINITE_COST;
+        HexCoord next = s;
+        for( int d = 0; d < 6; ++d )
+        {
+            HexCoord n = Neighbor( s, HexDirection(d) );
+            if( !map.valid(n) || g[n] >= INFINITE_COST )
+                continue;
+            int c = cost( map, s, d, n );
+            if( c < INFINITE_COST && c + g[n] < best )
+            {
+                best = c + g[n];
+                next = n;
+            }
+        }
+        if( best >= INFINITE_COST || forward.size() >= NUM_HEXES )
+            return false;
+        s = next;
+        forward.push_back( s );
+    }
+
+    while( !forward.empty() )
+    {
+        path.push_back( forward.back() );
+        forward.pop_back();
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+Replanner::Replanner()
+    :searches(0), repairs(0), expanded(0), calls(0)
+{
+    for( int i = 0; i < REPLAN_SLOTS; ++i )
+        states[i] = NULL;
+}
+
+Replanner::~Replanner()
+{
+    for( int i = 0; i < REPLAN_SLOTS; ++i )
+        delete states[i];
+}
+
+ReplanState* Replanner::state_for( Map& map, Unit* unit, const HexCoord& A,
+                                   const HexCoord& B )
+{
+    ReplanState* oldest = NULL;
+    for( int i = 0; i < REPLAN_SLOTS; ++i )
+    {
+        ReplanState* S = states[i];
+        if( S == NULL )
+        {
+            S = states[i] = new ReplanState;
+            oldest = S;
+            break;
+        }
+        if( S->current( map, unit, B ) )
+        {
+            // The blob moved from S->start to A since the last search
+            S->km += S->h( S->start, A );
+            S->start = A;
+            S->update_costs( map );
+            repairs++;
+            return S;
+        }
+        if( oldest == NULL || S->last_used < oldest->last_used )
+            oldest = S;
+    }
+
+    oldest->reset( map, unit, A, B );
+    searches++;
+    return oldest;
+}
+
+bool Replanner::find_path( Map& map, Unit* unit, const HexCoord& A,
+                           const HexCoord& B, int cutoff,
+                           vector<HexCoord>& path )
+{
+    // The heuristic needs a positive cheapest step
+    int div = path_div;
+    if( div < 3 || div > 12 || A == B || unit == NULL )
+        return false;
+
+    // FindUnitPath knows how to pick a neighbor of an occupied goal
+    if( map.blocked( B, unit, true ) )
+        return false;
+
+    ReplanState* S = state_for( map, unit, A, B );
+    S->last_used = ++calls;
+    S->update_blockers( map );
+
+    int limit = BasePathCutoff + cutoff * hex_distance( A, B ) / 10;
+    if( !S->compute( map, limit, expanded ) || !S->extract( map, path ) )
+    {
+        // Start over next time
+        S->valid = false;
+        return false;
+    }
+    return true;
+}
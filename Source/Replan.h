@@ -0,0 +1,62 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef Replan_h
+#define Replan_h
+
+// A blob that is blocked by other blobs asks for a new path to the same
+// place.  In a crowd that happens over and over, and each time only a
+// few hexes have changed.  The replanner keeps the searches of the last
+// few blocked blobs and repairs them (with D* Lite) instead of starting
+// over.  The search runs backwards from the goal, so the costs it has
+// found are still good after the blob has moved.
+//
+// Only blobs within REPLAN_RADIUS of the blob being planned count as
+// obstacles; the ones farther away will have moved by the time it gets
+// there.  Changes to the terrain costs (cost_version_) are repaired the
+// same way as blobs moving; a change to path_div throws a search away.
+// The replanner is only used from the simulation thread (see
+// PathPlanner.h), so it has no lock.
+
+const int REPLAN_SLOTS = 4;
+
+struct ReplanState;
+
+class Replanner
+{
+  public:
+    Replanner();
+    ~Replanner();
+
+    // Fill in a path (backwards, as for FindUnitPath) from A to B for
+    // this unit.  Returns false, leaving path alone, if B can't be
+    // reached or the search grew past the cutoff; the caller should then
+    // use FindUnitPath.
+    bool find_path( Map& map, Unit* unit, const HexCoord& A,
+                    const HexCoord& B, int cutoff, vector<HexCoord>& path );
+
+    int searches;               // statistics: searches started over
+    int repairs;                // searches that were repaired
+    long expanded;              // nodes expanded by both kinds
+
+  private:
+    ReplanState* states[REPLAN_SLOTS];
+    long calls;
+
+    ReplanState* state_for( Map& map, Unit* unit, const HexCoord& A,
+                            const HexCoord& B );
+};
+
+extern Replanner replanner;
+
+#endif
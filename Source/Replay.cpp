@@ -0,0 +1,439 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "MapCmd.h"
+#include "Replay.h"
+#include "PathPlanner.h"
+
+ReplayLog replay_log;
+
+static const char replay_magic[4] = { 'S', 'B', 'R', 'P' };
+static const int ReplayCheckpoint = 0xff;
+static const int ReplayOptions = 0xfe;
+static const int ReplayView = 0xfd;
+
+// Bits of the options record
+static const int ReplaySleeping = 1;
+static const int ReplayLOD = 2;
+static const int ReplayReserve = 4;
+
+// The file format is byte oriented so that logs can be moved between
+// machines and compilers
+static void write_long( FILE* f, unsigned long x )
+{
+    for( int i = 0; i < 4; i++ )
+        putc( int( ( x >> (8*i) ) & 0xff ), f );
+}
+
+static bool read_long( FILE* f, unsigned long& x )
+{
+    x = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+        int c = getc( f );
+        if( c == EOF ) return false;
+        x |= (unsigned long)(c) << (8*i);
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Recording
+
+bool ReplayLog::open( const char* filename, unsigned long seed )
+{
+    close();
+    file = fopen( filename, "wb" );
+    if( !file )
+    {
+        Log( "Replay", "Could not create the replay log" );
+        return false;
+    }
+
+    fwrite( replay_magic, 1, 4, file );
+    write_long( file, seed );
+    fflush( file );
+    last_options = -1;
+    for( int i = 0; i < 4; i++ )
+        last_view[i] = -1;
+    return true;
+}
+
+void ReplayLog::close()
+{
+    if( file )
+    {
+        fclose( file );
+        file = NULL;
+    }
+}
+
+void ReplayLog::record( long tick, const Command& c )
+{
+    if( !file ) return;
+
+    write_long( file, (unsigned long)(tick) );
+    putc( int(c.type), file );
+    putc( int(c.terrain), file );
+    putc( c.location.m & 0xff, file );
+    putc( c.location.n & 0xff, file );
+
+    // Commands are rare, so flushing each one is cheap, and it means
+    // the log survives a crash
+    fflush( file );
+}
+
+void ReplayLog::checkpoint( long tick, unsigned long hash )
+{
+    if( !file ) return;
+
+    write_long( file, (unsigned long)(tick) );
+    putc( ReplayCheckpoint, file );
+    for( int i = 0; i < 3; i++ )
+        putc( int( ( hash >> (8*i) ) & 0xff ), file );
+    fflush( file );
+}
+
+void ReplayLog::options( long tick, bool sleeping, bool lod, bool reserve )
+{
+    if( !file ) return;
+
+    int flags = ( sleeping? ReplaySleeping : 0 ) | ( lod? ReplayLOD : 0 )
+        | ( reserve? ReplayReserve : 0 );
+    if( flags == last_options ) return;
+    last_options = flags;
+
+    write_long( file, (unsigned long)(tick) );
+    putc( ReplayOptions, file );
+    putc( flags, file );
+    putc( 0, file );
+    putc( 0, file );
+    fflush( file );
+}
+
+void ReplayLog::view_area( long tick, int left, int bottom,
+                           int right, int top )
+{
+    if( !file ) return;
+
+    int view[4] = { left, bottom, right, top };
+    bool same = true;
+    for( int i = 0; i < 4; i++ )
+        if( view[i] != last_view[i] ) same = false;
+    if( same ) return;
+
+    // This is written on every tick the view scrolls, which is still
+    // rare next to the ticks simulated
+    write_long( file, (unsigned long)(tick) );
+    putc( ReplayView, file );
+    for( int i = 0; i < 4; i++ )
+    {
+        last_view[i] = view[i];
+        putc( view[i] & 0xff, file );
+    }
+    fflush( file );
+}
+
+//////////////////////////////////////////////////////////////////////
+// Playback
+
+// One record from the log.  Any kind that isn't a checkpoint, options,
+// or view record is a command type.
+struct ReplayRecord
+{
+    long tick;
+    int kind;
+    Command command;
+    unsigned long hash;         // checkpoint
+    int flags;                  // options
+    int view[4];                // view
+};
+
+// Returns false at the end of the file
+static bool read_record( FILE* f, ReplayRecord& r )
+{
+    unsigned long t;
+    if( !read_long( f, t ) ) return false;
+
+    // The view record is the only one with four bytes after the kind
+    int kind = getc( f );
+    int size = ( kind == ReplayView )? 4 : 3;
+    int b[4] = { 0, 0, 0, 0 };
+    for( int i = 0; i < size; i++ )
+        b[i] = getc( f );
+    if( b[size-1] == EOF ) return false;
+
+    r.tick = long(t);
+    r.kind = kind;
+    r.hash = (unsigned long)(b[0]) | ((unsigned long)(b[1]) << 8)
+        | ((unsigned long)(b[2]) << 16);
+    r.flags = b[0];
+    for( int i = 0; i < 4; i++ )
+        r.view[i] = b[i];
+    r.command.type = Command::Type(kind);
+    r.command.terrain = Terrain(b[0]);
+    r.command.location = HexCoord( b[1], b[2] );
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// World summaries, for measuring drift between two runs
+
+static const char* summary_file = "replay.sum";
+
+struct WorldSummary
+{
+    long ticks;
+    double seconds;
+    long water, altitude, food, labor, money;
+    long terrain[maxTerrain];
+
+    void collect( Map* map, double secs );
+    bool save( const char* filename ) const;
+    bool load( const char* filename );
+    void log( const char* title ) const;
+};
+
+void WorldSummary::collect( Map* map, double secs )
+{
+    ticks = map->time_tick_;
+    seconds = secs;
+    water = altitude = 0;
+    food = map->total_food;
+    labor = map->total_labor;
+    money = ::money;
+    for( int t = 0; t < maxTerrain; t++ )
+        terrain[t] = 0;
+
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            water += map->water(h);
+            altitude += map->altitude(h);
+            terrain[map->terrain(h)]++;
+        }
+}
+
+bool WorldSummary::save( const char* filename ) const
+{
+    FILE* f = fopen( filename, "w" );
+    if( !f ) return false;
+    fprintf( f, "%ld %f %ld %ld %ld %ld %ld", ticks, seconds,
+             water, altitude, food, labor, money );
+    for( int t = 0; t < maxTerrain; t++ )
+        fprintf( f, " %ld", terrain[t] );
+    fprintf( f, "\n" );
+    fclose( f );
+    return true;
+}
+
+bool WorldSummary::load( const char* filename )
+{
+    FILE* f = fopen( filename, "r" );
+    if( !f ) return false;
+    bool ok = fscanf( f, "%ld %lf %ld %ld %ld %ld %ld", &ticks, &seconds,
+                      &water, &altitude, &food, &labor, &money ) == 7;
+    for( int t = 0; ok && t < maxTerrain; t++ )
+        ok = fscanf( f, "%ld", &terrain[t] ) == 1;
+    fclose( f );
+    return ok;
+}
+
+void WorldSummary::log( const char* title ) const
+{
+    char s[256];
+    sprintf( s, "%s: water %ld altitude %ld food %ld labor %ld money %ld",
+             title, water, altitude, food, labor, money );
+    Log( "Replay", s );
+}
+
+// Percentage difference, relative to the full-rate value
+static double drift( long full, long lod )
+{
+    if( full == 0 ) return lod == 0? 0.0 : 100.0;
+    return 100.0 * double(lod - full) / double(labs(full));
+}
+
+static void log_drift( const WorldSummary& full, const WorldSummary& lod )
+{
+    char s[256];
+    if( full.ticks != lod.ticks )
+    {
+        sprintf( s, "The saved summary is for %ld ticks, not %ld",
+                 full.ticks, lod.ticks );
+        Log( "Replay", s );
+        return;
+    }
+
+    sprintf( s, "Time: %7.3f seconds at full rate, %7.3f with less detail"
+             " (%5.1f%% saved)", full.seconds, lod.seconds,
+             full.seconds > 0? -drift( long(full.seconds*1000),
+                                       long(lod.seconds*1000) ) : 0.0 );
+    Log( "Replay", s );
+    sprintf( s, "Drift: water %+.2f%% altitude %+.2f%% food %+.2f%%"
+             " labor %+.2f%% money %+.2f%%",
+             drift( full.water, lod.water ),
+             drift( full.altitude, lod.altitude ),
+             drift( full.food, lod.food ),
+             drift( full.labor, lod.labor ),
+             drift( full.money, lod.money ) );
+    Log( "Replay", s );
+
+    // Terrain is compared as the number of hexes that would have to
+    // change type to turn one histogram into the other
+    long moved = 0;
+    for( int t = 0; t < maxTerrain; t++ )
+        moved += labs( full.terrain[t] - lod.terrain[t] );
+    sprintf( s, "Drift: %ld of %d hexes differ in terrain type",
+             moved/2, NUM_HEXES );
+    Log( "Replay", s );
+}
+
+//////////////////////////////////////////////////////////////////////
+// Map::initialize wants someone to report progress to
+struct ReplayProgress
+{
+    bool message( const char* text )
+    {
+        Log( "Replay", text );
+        return false;           // never abort
+    }
+};
+
+long ReplayRun( const char* filename, long ticks, bool lod )
+{
+    FILE* f = fopen( filename, "rb" );
+    if( !f )
+    {
+        Log( "Replay", "Could not open the replay log" );
+        return 0;
+    }
+
+    char magic[4];
+    unsigned long seed;
+    if( fread( magic, 1, 4, f ) != 4 || memcmp( magic, replay_magic, 4 ) != 0
+        || !read_long( f, seed ) )
+    {
+        Log( "Replay", "Not a replay log" );
+        fclose( f );
+        return 0;
+    }
+
+    // Rebuild the world from its seed
+    Map* map = new Map( seed );
+    ReplayProgress progress;
+    map->initialize( closure( &progress, &ReplayProgress::message ) );
+
+    if( lod )
+    {
+        // Pretend a typical window is looking at the middle of the map
+        map->level_of_detail = true;
+        map->set_view_area( Map::MSize/2-20, Map::NSize/2-15,
+                            Map::MSize/2+20, Map::NSize/2+15 );
+    }
+
+    // Run the simulation the same way simulation_thread does, feeding
+    // in each command and option change just before the tick that first
+    // saw it.  A hash was recorded right after its tick was simulated, so
+    // it is checked at the same point.  With lod set, the recorded level
+    // of detail and view area are ignored in favor of the ones above.
+    ReplayRecord r;
+    bool more = read_record( f, r );
+    int num_commands = 0;
+    int num_checked = 0;
+    long diverged = -1;
+    bool lod_recorded = false;
+    clock_t c0 = clock();
+    while( ticks < 0? more : map->time_tick_ < ticks )
+    {
+        while( more && r.tick <= map->time_tick_ )
+        {
+            if( r.kind == ReplayCheckpoint )
+            {
+                if( r.tick == map->time_tick_ )
+                {
+                    num_checked++;
+                    if( diverged < 0
+                        && r.hash != ( map->tick_hash() & 0xffffffUL ) )
+                        diverged = r.tick;
+                }
+            }
+            else if( r.kind == ReplayOptions )
+            {
+                map->sector_sleeping = ( r.flags & ReplaySleeping ) != 0;
+                map->path_reservations = ( r.flags & ReplayReserve ) != 0;
+                if( r.flags & ReplayLOD )
+                    lod_recorded = true;
+                if( !lod )
+                    map->level_of_detail = ( r.flags & ReplayLOD ) != 0;
+            }
+            else if( r.kind == ReplayView )
+            {
+                if( !lod )
+                    map->set_view_area( r.view[0], r.view[1],
+                                        r.view[2], r.view[3] );
+            }
+            else
+            {
+                map_commands.push( r.command );
+                num_commands++;
+            }
+            more = read_record( f, r );
+        }
+        map->process_commands();
+        map->simulate();
+    }
+    clock_t c1 = clock();
+    fclose( f );
+
+    long ticks_run = map->time_tick_;
+    char s[256];
+    sprintf( s, "%ld ticks, %d commands, seed %lu: %7.3f seconds, hash %08lx, "
+             "%d sectors asleep",
+             ticks_run, num_commands, seed, double(c1-c0)/CLK_TCK,
+             map->tick_hash(), map->num_asleep_ );
+    Log( "Replay", s );
+    path_planner.report();
+    if( lod )
+        sprintf( s, "Level of detail was on, so the hashes were not checked" );
+    else if( diverged >= 0 )
+        sprintf( s, "Diverged from the recording at tick %ld", diverged );
+    else
+        sprintf( s, "Matched the recording at %d checkpoints", num_checked );
+    Log( "Replay", s );
+
+    WorldSummary summary;
+    summary.collect( map, double(c1-c0)/CLK_TCK );
+    summary.log( lod? "Less detail"
+                 : lod_recorded? "As recorded" : "Full rate" );
+    if( !lod && lod_recorded )
+        Log( "Replay", "Level of detail was on in the recording, "
+             "so this is not saved as the full-rate summary" );
+    else if( !lod )
+        summary.save( summary_file );
+    else
+    {
+        WorldSummary full;
+        if( full.load( summary_file ) )
+            log_drift( full, summary );
+        else
+            Log( "Replay", "No full-rate summary to compare against" );
+    }
+
+    delete map;
+    return ticks_run;
+}
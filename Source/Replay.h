@@ -0,0 +1,77 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#ifndef Replay_h
+#define Replay_h
+
+// A replay log holds the world seed and every command the simulation
+// took from map_commands, along with the tick it was taken on.  Running
+// the log again (in a fresh process, with the same InitMap.txt) rebuilds
+// the same world and applies the same commands on the same ticks, so the
+// simulation reaches the same state.  I use this to reproduce slowdowns
+// and to compare two versions of the simulation on the same workload.
+//
+// Once a day the world hash is written too, so that a replay can report
+// the first day on which it went a different way.
+//
+// The options that change what the simulation computes (sector sleeping,
+// level of detail, and path reservations) are written whenever they change, and so is the
+// part of the map on screen while level of detail is on.
+//
+// The file is append-only.  All numbers are stored low byte first.
+//     header:  'S' 'B' 'R' 'P'  seed:4
+//     command: tick:4  type:1  terrain:1  m:1  n:1
+//     hash:    tick:4  0xff:1  low 24 bits of Map::tick_hash():3
+//     options: tick:4  0xfe:1  flags:1  0:2
+//     view:    tick:4  0xfd:1  left:1  bottom:1  right:1  top:1
+
+struct Command;
+
+class ReplayLog
+{
+  protected:
+    FILE* file;
+    int last_options;           // the flags last written, or -1
+    int last_view[4];           // the view area last written
+
+  public:
+    ReplayLog(): file(NULL), last_options(-1) {}
+    ~ReplayLog() { close(); }
+
+    bool open( const char* filename, unsigned long seed );
+    void close();
+    bool recording() const { return file != NULL; }
+
+    void record( long tick, const Command& c );
+    void checkpoint( long tick, unsigned long hash );
+
+    // These only write when something changed since the last call
+    void options( long tick, bool sleeping, bool lod, bool reserve );
+    void view_area( long tick, int left, int bottom, int right, int top );
+};
+
+extern ReplayLog replay_log;
+
+// Rebuild the world from a log and run it, either until the last command
+// has been applied (ticks < 0) or for the given number of ticks.  Returns
+// the number of ticks simulated.
+//
+// A summary of the final world (totals of water, altitude, food, labor,
+// money, and the count of each terrain type) is logged.  A full-rate run
+// saves it in replay.sum; a run with lod set (level of detail on, with
+// a fixed screen-sized area in the middle of the map) compares itself
+// against that file, which measures both the time saved and the drift.
+// Without lod, the level of detail settings in the log are followed, and
+// if level of detail was ever on, the run is not saved as full rate.
+long ReplayRun( const char* filename, long ticks = -1, bool lod = false );
+
+#endif
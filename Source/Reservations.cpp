@@ -0,0 +1,75 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Path.h"
+#include "Unit.h"
+#include "Reservations.h"
+
+ReservationTable reservations;
+
+bool ReservationTable::current( Map& map, const ReserveEntry& e )
+{
+    Unit* u = map.units[e.unit];
+    return !u->dead() && u->reserve_number == e.number;
+}
+
+void ReservationTable::reserve( Map& map, Unit* unit,
+                                const vector<HexCoord>& path )
+{
+    int n = path.size();
+    long t = map.time_tick_;
+    for( int i = n-1; i >= 0 && i >= n-1-RESERVE_HORIZON; --i )
+    {
+        // The blob is in path[i] from t until it gets to the next hex.
+        // If a blob is standing in the next hex, nobody knows when it
+        // will get there, so nothing after this hex is reserved.
+        bool stuck = ( i > 0 && map.blocked( path[i-1], unit, false ) );
+        long t1 = t;
+        if( i > 0 && !stuck )
+            t1 += step_ticks( static_movement_cost( map, path[i], path[i-1] ) );
+        for( long s = t / RESERVE_TICKS; s <= t1 / RESERVE_TICKS; ++s )
+        {
+            ReserveKey key( s, path[i] );
+            ReserveMap::iterator e = table.find( key );
+            if( e == table.end() )
+                table[key] = ReserveEntry( unit->index, unit->reserve_number );
+            else if( !current( map, (*e).second ) )
+                (*e).second = ReserveEntry( unit->index, unit->reserve_number );
+        }
+        if( stuck )
+            break;
+        t = t1;
+    }
+}
+
+bool ReservationTable::reserved( Map& map, const HexCoord& h, long tick,
+                                 Unit* unit )
+{
+    if( table.empty() )
+        return false;
+    ReserveMap::iterator e = table.find( ReserveKey( tick / RESERVE_TICKS, h ) );
+    if( e == table.end() )
+        return false;
+    const ReserveEntry& r = (*e).second;
+    return map.units[r.unit] != unit && current( map, r );
+}
+
+void ReservationTable::expire( long tick )
+{
+    table.erase( table.begin(),
+                 table.lower_bound( ReserveKey( tick / RESERVE_TICKS, 0 ) ) );
+}
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+
+#ifndef Reservations_h
+#define Reservations_h
+
+#include <map.h>
+
+// With path reservations on, a blob that gets a path reserves the hexes
+// on its next RESERVE_HORIZON steps for the times it expects to be in
+// them, in slots of RESERVE_TICKS ticks.  The unit path finder charges
+// RESERVE_PENALTY for stepping into a hex at a time when another blob
+// has it reserved, so blobs heading for the same gate or bridge spread
+// out over time or go another way, instead of meeting there and waiting
+// and replanning.
+//
+// A blob's reservations are dropped when it stops or gets a new path.
+// Instead of finding and erasing them, the blob's reserve_number is
+// bumped, and reservations made under an older number don't count.
+// Reservations for slots in the past are thrown out every tick.
+//
+// The table is changed only by the simulation thread between planning
+// batches, and only read during them, so it has no lock.
+
+const int RESERVE_TICKS = 8;
+const int RESERVE_HORIZON = 16;
+const int RESERVE_PENALTY = 40;
+
+struct ReserveKey
+{
+    long slot;
+    unsigned short hex;         // m | (n << 8), like iterator_order
+    ReserveKey( long s, const HexCoord& h )
+        : slot(s), hex( (unsigned short)( h.m | ( h.n << 8 ) ) ) {}
+    ReserveKey( long s, unsigned short h ): slot(s), hex(h) {}
+    ReserveKey(): slot(0), hex(0) {}
+};
+
+inline bool operator < ( const ReserveKey& a, const ReserveKey& b )
+{
+    return a.slot < b.slot || ( a.slot == b.slot && a.hex < b.hex );
+}
+
+struct ReserveEntry
+{
+    int unit;                   // index in Map::units
+    int number;                 // the blob's reserve_number at the time
+    ReserveEntry( int u, int k ): unit(u), number(k) {}
+    ReserveEntry(): unit(-1), number(0) {}
+};
+
+typedef map< ReserveKey, ReserveEntry, less<ReserveKey> > ReserveMap;
+
+class ReservationTable
+{
+  public:
+    ReservationTable() {}
+    ~ReservationTable() {}
+
+    // Reserve the next part of a blob's path (kept in reverse order)
+    void reserve( Map& map, Unit* unit, const vector<HexCoord>& path );
+
+    // Is hex h reserved at this tick by a blob other than this one?
+    bool reserved( Map& map, const HexCoord& h, long tick, Unit* unit );
+
+    // Throw out reservations for slots before this tick
+    void expire( long tick );
+
+    int size() { return table.size(); }
+
+  private:
+    ReserveMap table;
+
+    bool current( Map& map, const ReserveEntry& e );
+};
+
+extern ReservationTable reservations;
+
+// How many ticks a step of this cost takes (see Unit::step)
+inline long step_ticks( int cost )
+{
+    return cost * HexYSpacing / 40;
+}
+
+#endif
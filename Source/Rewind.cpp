@@ -0,0 +1,374 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#include "std.h"
+
+#include "Notion.h"
+#include "Map.h"
+#include "Map_Const.h"
+#include "Rewind.h"
+
+const int REWIND_DAYS = 28;
+const int REWIND_INTERVAL = TICKS_PER_DAY;
+
+RewindBuffer rewind_buffer;
+
+enum
+{
+    FieldTerrain = 0x001, FieldAltitude = 0x002, FieldWater = 0x004,
+    FieldMoisture = 0x008, FieldLabor = 0x010, FieldFood = 0x020,
+    FieldHeat = 0x040, FieldExtra = 0x080, FieldFlags = 0x100,
+    FieldMarket = 0x200
+};
+
+//////////////////////////////////////////////////////////////////////
+WorldState::WorldState()
+    :tick(-1), money(0), volcano(0,0), volcano_time(0),
+     terrain(Clear), altitude(0), water(0), moisture(0), labor(0),
+     food(0), heat(0), extra(0), flags(0), nearest_market(0)
+{
+}
+
+void WorldState::capture( const Map& map )
+{
+    tick = map.time_tick_;
+    money = ::money;
+    volcano = map.volcano_;
+    volcano_time = map.volcano_time_;
+
+    terrain = map.terrain_;
+    altitude = map.altitude_;
+    water = map.water_;
+    moisture = map.moisture_;
+    labor = map.labor_;
+    food = map.food_;
+    heat = map.heat_;
+    extra = map.extra_;
+    flags = map.flags_;
+    nearest_market = map.nearest_market_;
+
+    blobs.erase( blobs.begin(), blobs.end() );
+    for( vector<Unit*>::const_iterator u = map.live_units.begin();
+         u != map.live_units.end(); ++u )
+        if( !(*u)->dead() )
+        {
+            BlobState b;
+            b.type = (*u)->type;
+            b.loc = (*u)->hexloc();
+            b.home = (*u)->home;
+            b.final_dest = (*u)->final_dest;
+            blobs.push_back( b );
+        }
+    jobs = ::jobs;
+}
+
+void WorldState::restore( Map& map ) const
+{
+    map.time_tick_ = tick;
+    ::money = money;
+    map.volcano_ = volcano;
+    map.volcano_time_ = volcano_time;
+
+    map.terrain_ = terrain;
+    map.altitude_ = altitude;
+    map.water_ = water;
+    map.moisture_ = moisture;
+    map.labor_ = labor;
+    map.food_ = food;
+    map.heat_ = heat;
+    map.extra_ = extra;
+    map.flags_ = flags;
+    map.nearest_market_ = nearest_market;
+
+    // Everything has to be redrawn, and the watchtower list, the
+    // terrain sets, and the sector counts have to be rebuilt from the
+    // terrain
+    map.watchtowers_.erase( map.watchtowers_.begin(), map.watchtowers_.end() );
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            map.damage( h );
+            if( map.terrain(h) == WatchFire )
+                map.watchtowers_.push_back( WatchtowerFire(h) );
+        }
+    map.rebuild_terrain_sets();
+    map.collect_sector_statistics();
+    map.recompute_hash();
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        ++map.cost_version_[s];
+        for( int t = 0; t < maxTerrain; ++t )
+            ++map.terrain_version_[t][s];
+    }
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+            map.edge_dirty_[HexCoord(m,n)] = 1;
+
+    // The jobs keep their positions in the jobs vector, but nobody is
+    // working on them yet
+    extern void JobSet( int i, const HexCoord& location, Terrain t );
+    for( int j = 0; j < jobs.size(); ++j )
+    {
+        ::jobs.push_back( Job() );
+        if( jobs[j].build != -1 )
+            JobSet( j, jobs[j].location, Terrain(jobs[j].build) );
+    }
+
+    for( int i = 0; i < blobs.size(); ++i )
+    {
+        const BlobState& b = blobs[i];
+        Unit* unit = Unit::make( &map, b.type, b.loc );
+        unit->home = b.home;
+        if( map.valid(b.final_dest) && b.final_dest != b.loc )
+            unit->set_dest( &map, b.final_dest );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+void WorldDelta::apply( WorldState& s ) const
+{
+    int v = 0;
+    for( int i = 0; i < hexes.size(); ++i )
+    {
+        HexCoord h( hexes[i] & 0xff, hexes[i] >> 8 );
+        int f = fields[i];
+        if( f & FieldTerrain )  s.terrain[h] = Terrain(values[v++]);
+        if( f & FieldAltitude ) s.altitude[h] = values[v++];
+        if( f & FieldWater )    s.water[h] = values[v++];
+        if( f & FieldMoisture ) s.moisture[h] = values[v++];
+        if( f & FieldLabor )    s.labor[h] = values[v++];
+        if( f & FieldFood )     s.food[h] = values[v++];
+        if( f & FieldHeat )     s.heat[h] = values[v++];
+        if( f & FieldExtra )    s.extra[h] = byte(values[v++]);
+        if( f & FieldFlags )    s.flags[h] = byte(values[v++]);
+        if( f & FieldMarket )
+            s.nearest_market[h] = (unsigned short)(values[v++]);
+    }
+
+    s.tick = tick;
+    s.money = money;
+    s.volcano = volcano;
+    s.volcano_time = volcano_time;
+    s.blobs = blobs;
+    s.jobs = jobs;
+}
+
+// Add one field to the delta, if it changed
+inline void delta_field( WorldDelta& d, unsigned& fields, unsigned bit,
+                         long old_value, long new_value )
+{
+    if( old_value != new_value )
+    {
+        fields |= bit;
+        d.values.push_back( new_value );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+RewindBuffer::RewindBuffer()
+    :running(false), busy(false), generation(0),
+     staging(new WorldState), staging_damage(new MapArray<long>(0)),
+     staging_generation(0),
+     have_snapshot(false), base(new WorldState), latest(new WorldState)
+{
+}
+
+RewindBuffer::~RewindBuffer()
+{
+    running = false;
+    Mutex::Lock lock( mutex );
+    for( deque<WorldDelta*>::iterator i = deltas.begin();
+         i != deltas.end(); ++i )
+        delete (*i);
+    delete staging;
+    delete staging_damage;
+    delete base;
+    delete latest;
+}
+
+void RewindBuffer::wait_for_encoder()
+{
+    while( busy )
+        DosSleep( 1 );
+}
+
+void RewindBuffer::capture( const Map& map )
+{
+    if( map.time_tick_ % REWIND_INTERVAL != 0 )
+        return;
+
+    // Normally the only work done on the simulation thread is a straight
+    // copy, so that the encoder sees a consistent world
+    wait_for_encoder();
+    staging->capture( map );
+    *staging_damage = map.damage_;
+    staging_generation = generation;
+    busy = true;
+    if( running )
+        ready.post();
+    else
+    {
+        encode();
+        busy = false;
+    }
+}
+
+int RewindBuffer::encoder_thread( int )
+{
+    running = true;
+
+    while( running )
+    {
+        if( !ready.wait( 500 ) )
+            continue;
+        ready.reset();
+        if( busy )
+        {
+            encode();
+            busy = false;
+        }
+    }
+    return 0;
+}
+
+void RewindBuffer::encode()
+{
+    Mutex::Lock lock( mutex );
+
+    // The world was rewound after this copy was made
+    if( staging_generation != generation )
+        return;
+
+    if( !have_snapshot )
+    {
+        *base = *staging;
+        *latest = *staging;
+        have_snapshot = true;
+        return;
+    }
+
+    WorldDelta* d = new WorldDelta;
+    d->tick = staging->tick;
+    d->money = staging->money;
+    d->volcano = staging->volcano;
+    d->volcano_time = staging->volcano_time;
+    d->blobs = staging->blobs;
+    d->jobs = staging->jobs;
+
+    const WorldState& A = *latest;
+    const WorldState& B = *staging;
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            unsigned fields = 0;
+
+            // Terrain, altitude, and water changes always mark damage_
+            if( (*staging_damage)[h] > A.tick )
+            {
+                delta_field( *d, fields, FieldTerrain, A.terrain[h], B.terrain[h] );
+                delta_field( *d, fields, FieldAltitude, A.altitude[h], B.altitude[h] );
+                delta_field( *d, fields, FieldWater, A.water[h], B.water[h] );
+            }
+
+            // The rest can change quietly, so they're always compared
+            delta_field( *d, fields, FieldMoisture, A.moisture[h], B.moisture[h] );
+            delta_field( *d, fields, FieldLabor, A.labor[h], B.labor[h] );
+            delta_field( *d, fields, FieldFood, A.food[h], B.food[h] );
+            delta_field( *d, fields, FieldHeat, A.heat[h], B.heat[h] );
+            delta_field( *d, fields, FieldExtra, A.extra[h], B.extra[h] );
+            delta_field( *d, fields, FieldFlags, A.flags[h], B.flags[h] );
+            delta_field( *d, fields, FieldMarket,
+                         A.nearest_market[h], B.nearest_market[h] );
+
+            if( fields != 0 )
+            {
+                d->hexes.push_back( (unsigned short)( m | (n << 8) ) );
+                d->fields.push_back( (unsigned short)(fields) );
+            }
+        }
+
+    d->apply( *latest );
+    deltas.push_back( d );
+
+    // Fold the oldest changes into the base snapshot
+    while( deltas.size() > REWIND_DAYS * TICKS_PER_DAY / REWIND_INTERVAL )
+    {
+        WorldDelta* oldest = deltas.front();
+        deltas.pop_front();
+        oldest->apply( *base );
+        delete oldest;
+    }
+}
+
+long RewindBuffer::oldest_tick()
+{
+    Mutex::Lock lock( mutex );
+    return have_snapshot? base->tick : -1;
+}
+
+long RewindBuffer::newest_tick()
+{
+    Mutex::Lock lock( mutex );
+    return have_snapshot? latest->tick : -1;
+}
+
+bool RewindBuffer::restore( Map& map, long tick )
+{
+    // Let the encoder finish the last day first, so that it's in the
+    // buffer no matter how the threads were scheduled
+    wait_for_encoder();
+
+    Mutex::Lock lock( mutex );
+    if( !have_snapshot || tick < base->tick )
+        return false;
+
+    // Rebuild the snapshot, starting from the base
+    WorldState* state = new WorldState;
+    *state = *base;
+    int k = 0;
+    while( k < deltas.size() && deltas[k]->tick <= tick )
+        deltas[k++]->apply( *state );
+
+    // Forget the future
+    while( deltas.size() > k )
+    {
+        delete deltas.back();
+        deltas.pop_back();
+    }
+    *latest = *state;
+    ++generation;
+
+    {
+        Mutex::Lock map_lock( map.mutex );
+        Mutex::Lock unit_lock( map.unit_mutex );
+
+        for( vector<Unit*>::iterator u = map.live_units.begin();
+             u != map.live_units.end(); ++u )
+            if( !(*u)->dead() ) (*u)->die( &map );
+        // Put them on the free list, so that the restored blobs reuse
+        // them instead of making new blocks
+        Unit::sweep( &map );
+
+        extern void JobKill( int i );
+        for( int j = 0; j < jobs.size(); ++j )
+            JobKill( j );
+        jobs.erase( jobs.begin(), jobs.end() );
+
+        state->restore( map );
+        ++map.rewinds_;
+    }
+
+    delete state;
+    return true;
+}
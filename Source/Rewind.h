@@ -0,0 +1,136 @@
+//
+// Copyright (C) 1999 Amit J. Patel
+//
+// Permission to use, copy, modify, distribute and sell this software
+// and its documentation for any purpose is hereby granted without fee,
+// provided that the above copyright notice appear in all copies and
+// that both that copyright notice and this permission notice appear
+// in supporting documentation.  Amit J. Patel makes no
+// representations about the suitability of this software for any
+// purpose.  It is provided "as is" without express or implied warranty.
+//
+
+#ifndef Rewind_h
+#define Rewind_h
+
+// The rewind buffer keeps the last few weeks of the world so that the
+// player (or a test) can jump back in time.  Once a day the simulation
+// thread copies the world into a staging area; a separate thread then
+// encodes it as the changes since the previous snapshot.  Hexes whose
+// damage_ mark is older than the previous snapshot are not compared for
+// terrain, altitude, or water.  Only one full copy of the world (the
+// oldest snapshot) is kept; when the buffer is full, the oldest set of
+// changes is folded into it.  Restoring a tick applies at most
+// REWIND_DAYS sets of changes.
+//
+// Blobs and jobs are kept whole in every snapshot, since there are few
+// of them.  A blob comes back in its hex with its home and destination,
+// and plans a new path; builders are given the jobs again by the job
+// index.
+//
+// A rewind is a command (Command::Rewind), so it happens between ticks
+// on the simulation thread and is written to the replay log.  To make
+// it come out the same way in a replay, a snapshot is taken on every
+// day boundary: if the encoder is still busy with the last one, the
+// simulation waits for it, and with no encoder thread (in a replay)
+// the simulation encodes the snapshot itself.
+
+// A blob, as stored in a snapshot
+struct BlobState
+{
+    Unit::Type type;
+    HexCoord loc;
+    HexCoord home;
+    HexCoord final_dest;
+};
+
+// The world, as stored in a snapshot
+struct WorldState
+{
+    long tick;
+    int money;
+    HexCoord volcano;
+    int volcano_time;
+
+    MapArray<Terrain> terrain;
+    MapArray<value> altitude;
+    MapArray<value> water;
+    MapArray<value> moisture;
+    MapArray<value> labor;
+    MapArray<value> food;
+    MapArray<value> heat;
+    MapArray<byte> extra;
+    MapArray<byte> flags;
+    MapArray<unsigned short> nearest_market;
+    vector<BlobState> blobs;
+    vector<Job> jobs;
+
+    WorldState();
+    ~WorldState() {}
+
+    void capture( const Map& map );
+    void restore( Map& map ) const;
+};
+
+// The changes from one snapshot to the next
+struct WorldDelta
+{
+    long tick;
+    int money;
+    HexCoord volcano;
+    int volcano_time;
+
+    vector<unsigned short> hexes;   // m | (n << 8), like iterator_order
+    vector<unsigned short> fields;  // which fields changed at each hex
+    vector<long> values;            // the new values, in field order
+    vector<BlobState> blobs;        // all of them
+    vector<Job> jobs;
+
+    void apply( WorldState& s ) const;
+};
+
+inline void destroy( WorldDelta** ) {}
+
+class RewindBuffer
+{
+  public:
+    RewindBuffer();
+    ~RewindBuffer();
+
+    // Called by the simulation thread after each tick.  When a snapshot
+    // is due, the world is copied and handed off to the encoder.
+    void capture( const Map& map );
+
+    // Go back to the newest snapshot at or before the given tick.
+    // Returns false if that tick is no longer in the buffer.  Only the
+    // simulation thread may call this (see Command::Rewind).
+    bool restore( Map& map, long tick );
+
+    long oldest_tick();
+    long newest_tick();
+
+    int encoder_thread( int );
+
+  private:
+    Mutex mutex;                // protects everything below staging
+    EventSem ready;
+    volatile bool running;
+    volatile bool busy;         // staging holds a copy not yet encoded
+    int generation;             // bumped by restore, to discard staging
+
+    WorldState* staging;
+    MapArray<long>* staging_damage;
+    int staging_generation;
+
+    bool have_snapshot;
+    WorldState* base;           // the oldest snapshot
+    WorldState* latest;         // the newest snapshot
+    deque<WorldDelta*> deltas;  // base -> ... -> latest
+
+    void encode();
+    void wait_for_encoder();
+};
+
+extern RewindBuffer rewind_buffer;
+
+#endif
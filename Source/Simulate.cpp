@@ -17,9 +17,11 @@
 #include "Map_Const.h"
 
 #include "MapCmd.h"
+#include "FeatureField.h"
 
 #include <algo.h>
 #include "path.h"
+#include "Rewind.h"
 
 void Map::collect_sector_statistics()
 {
@@ -27,17 +29,87 @@ void Map::collect_sector_statistics()
     {
         num_fires_[s] = 0;
         num_trees_[s] = 0;
+        for( int i = 0; i < fires_[s].size(); ++i )
+            fire_slot_[fires_[s][i]] = -1;
+        fires_[s].erase( fires_[s].begin(), fires_[s].end() );
     }
 
-    for( int m = 1; m <= Map::MSize; ++m )
-        for( int n = 1; n <= Map::NSize; ++n )
+    // Fire, lava, and blobs keep a sector awake even when they don't
+    // change anything.  Water only does when it moves (set_water).
+    for( TerrainSetIterator i( hexes(Fire) ); !i.done(); ++i )
+    {
+        ++num_fires_[sector(*i)];
+        add_fire( *i );
+        wake( *i );
+    }
+    for( TerrainSetIterator i( hexes(Lava) ); !i.done(); ++i )
+        wake( *i );
+    for( TerrainSetIterator i( hexes(Trees) ); !i.done(); ++i )
+        if( extra_[*i] >= TREE_MATURITY )
+            ++num_trees_[sector(*i)];
+
+    for( vector<Unit*>::iterator u = live_units.begin();
+         u != live_units.end(); ++u )
+        if( !(*u)->dead() )
+            wake( (*u)->loc );
+
+    for( int j = 0; j < jobs.size(); ++j )
+        if( jobs[j].build != -1 && valid( jobs[j].location ) )
+            wake( jobs[j].location );
+}
+
+void Map::update_sleeping()
+{
+    bool enabled = sleeping_;
+    num_asleep_ = 0;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        bool quiet = enabled;
+        int sm = s / NUM_SECTORS_X, sn = s % NUM_SECTORS_X;
+        for( int m = sm-1; m <= sm+1 && quiet; ++m )
+            for( int n = sn-1; n <= sn+1 && quiet; ++n )
+            {
+                if( m < 0 || m >= NUM_SECTORS_X || n < 0 || n >= NUM_SECTORS_Y )
+                    continue;
+                // After a rewind the activity can be in the future,
+                // which also counts as recent
+                if( time_tick_ - sector_active_[m*NUM_SECTORS_X+n]
+                    < SECTOR_SLEEP_TICKS )
+                    quiet = false;
+            }
+        asleep_[s] = quiet;
+        if( quiet ) num_asleep_++;
+    }
+}
+
+// How many sectors lie between the span [lo,hi) and the visible span
+static int sector_gap( int lo, int hi, int view_lo, int view_hi, int size )
+{
+    int gap = 0;
+    if( hi <= view_lo ) gap = view_lo - hi;
+    else if( lo >= view_hi ) gap = lo - view_hi;
+    return ( gap + size - 1 ) / size;
+}
+
+void Map::update_lod()
+{
+    bool enabled = lod_on_;
+    for( int s = 0; s < NUM_SECTORS; ++s )
+    {
+        int k = 1;
+        if( enabled )
         {
-            HexCoord h(m,n);
-            if( terrain(h) == Fire )
-                ++num_fires_[sector(h)];
-            if( terrain(h) == Trees && extra_[h] >= TREE_MATURITY )
-                ++num_trees_[sector(h)];
+            HexCoord o = sector_origin( s );
+            int dm = sector_gap( o.m, o.m+SECTOR_X_SIZE,
+                                 lod_left_, lod_right_, SECTOR_X_SIZE );
+            int dn = sector_gap( o.n, o.n+SECTOR_Y_SIZE,
+                                 lod_bottom_, lod_top_, SECTOR_Y_SIZE );
+            int d = max( dm, dn );
+            if( d >= 3 ) k = LOD_FAR_RATE;
+            else if( d == 2 ) k = LOD_NEAR_RATE;
         }
+        lod_[s] = k;
+    }
 }
 
 void Map::calculate_center()
@@ -47,18 +119,20 @@ void Map::calculate_center()
     int total_m = 0, total_n = 0, total_civilized = 0;
     for( int m = 1; m <= Map::MSize; ++m )
         for( int n = 1; n <= Map::NSize; ++n )
-        {
             prefs_[HexCoord(m,n)] = 0; // compatibility with old pref system
-            
-            // Add coordinates if this space is 'civilized'
-            Terrain t = terrain(HexCoord(m,n));
-            if( t == Road || t == Bridge || t == Houses || t == Market )
-            {
-                ++total_civilized;
-                total_m += m;
-                total_n += n;
-            }
+
+    // Add coordinates of the spaces that are 'civilized'
+    static const Terrain civilized[] = { Road, Bridge, Houses, Market };
+    for( int k = 0; k < 4; ++k )
+    {
+        const TerrainSet& set = hexes( civilized[k] );
+        total_civilized += set.count();
+        for( TerrainSetIterator i( set ); !i.done(); ++i )
+        {
+            total_m += (*i).m;
+            total_n += (*i).n;
         }
+    }
 
     HexCoord new_center;
     if( total_civilized > 0 )
@@ -78,11 +152,16 @@ void Map::calculate_center()
 
 void Map::calculate_prefs()
 {
-    static int pos = 0;
+    // The markets don't change during this loop, so the field is only
+    // brought up to date once
+    FeatureField* markets_field = feature_field( Market );
+
+    static int pos = 0, pass = 0;
     for( int i = 0; i < NUM_HEXES/100; ++i )
     {
         HexCoord h1; hex_position( pos++, h1 );
-        if( pos >= NUM_HEXES ) pos = 0;
+        if( pos >= NUM_HEXES ) { pos = 0; ++pass; }
+        if( lod_skip( h1, pass ) ) continue;
 
         // Now we have to count the nearby objects
         int roads[5] = {0,0,0,0,0};
@@ -94,9 +173,6 @@ void Map::calculate_prefs()
         int m2_left = max(h1.m-4,1), m2_right = min(h1.m+4,int(Map::MSize));
         int n2_left = max(h1.n-4,1), n2_right = min(h1.n+4,int(Map::NSize));
 
-        int nearest_market_dist = 1000;
-        HexCoord nearest_market_loc(h1);
-        
         for( int m2 = m2_left; m2 <= m2_right; ++m2 )
         {
             for( int n2 = n2_left; n2 <= n2_right; ++n2 )
@@ -109,15 +185,6 @@ void Map::calculate_prefs()
                 int d = hex_distance(h1,h2)/10;
                 if( d > 4 ) continue;
 
-                if( t2 == Market && d < nearest_market_dist )
-                {
-                    // Keep track of the nearest market; note that
-                    // this is skewed because of the d < ..., and
-                    // certain directions are examined first.
-                    nearest_market_dist = d;
-                    nearest_market_loc = h2;
-                }
-
                 food += food_[h2];
                 labor += labor_[h2];
                 
@@ -130,8 +197,12 @@ void Map::calculate_prefs()
             }
         }
 
-        // Now store the offset to the nearest market
-        set_nearest_market( h1, nearest_market_loc );
+        // Now store the offset to the nearest market, if it's close
+        HexCoord market = h1;
+        int market_distance = markets_field->distance( h1 );
+        if( market_distance != -1 && market_distance <= 4 )
+            market = markets_field->nearest( h1 );
+        set_nearest_market( h1, market );
         
         int sum_roads = roads[0]+roads[1]+roads[2]+roads[3]+roads[4];
         if( sum_roads == 0 ) continue;
@@ -876,20 +947,26 @@ void Map::add_farms()
 
 void Map::add_trees()
 {
-    static int pos = 0;
+    static int pos = 0, pass = 0;
     for( int i = 0; i < NUM_HEXES/500; ++i )
     {
         HexCoord h; hex_position( pos++, h );
-        if( pos >= NUM_HEXES ) pos = 0;
+        if( pos >= NUM_HEXES ) { pos = 0; ++pass; }
 
         Terrain t = terrain( h );
 
+        // Fires always run at full rate; trees far away age in steps
+        int k = ( t == Fire )? 1 : lod( h );
+        if( k > 1 && lod_skip( h, pass ) )
+            continue;
+
         if( t == Trees || t == Fire || t == Scorched )
         {
             int t1 = 30 + ByteRandom(20);
             if( t == Fire )
                 t1 = t1 / 12;
-            if( ++extra_[h] > t1 )
+            extra_[h] += k;
+            if( extra_[h] > t1 )
             {
                 // Tree, Fire, or Scorched dies
                 // (make sure extra does not exceed 255)
@@ -904,7 +981,7 @@ void Map::add_trees()
 
             // Old trees may lead to young trees nearby
             if( t == Trees && extra_[h] >= TREE_MATURITY &&
-                ShortRandom(MAX_MOISTURE*12) <= 2+moisture(h) )
+                ShortRandom(MAX_MOISTURE*12) < k*(3+moisture(h)) )
             {
                 for( int dir = 0; dir < 6; ++dir )
                 {
@@ -957,13 +1034,8 @@ void Map::lava_flow()
     ++volcano_time_;
     if( volcano_time_ > 120 )
     {
-        for( int m = 1; m <= Map::MSize; ++m )
-            for( int n = 1; n <= Map::NSize; ++n )
-            {
-                HexCoord h(m,n);
-                if( terrain(h) == Lava )
-                    set_terrain(h,Clear);
-            }
+        for( TerrainSetIterator i( hexes(Lava) ); !i.done(); ++i )
+            set_terrain( *i, Clear );
         volcano_ = HexCoord(0,0);
         return;
     }
@@ -1028,6 +1100,8 @@ void Map::simulate_environment()
     if( !lock.locked() )
         return;
 
+    update_sleeping();
+    update_lod();
     water_flow();
     lava_flow();
     
@@ -1050,6 +1124,10 @@ void Map::simulate_environment()
 
     if( time_tick_ % 64 == 9 )
         collect_sector_statistics();
+
+    // Spread heat out from the fires
+    if( heat_interval > 0 && time_tick_ % heat_interval == 0 )
+        diffuse_heat();
     
     // Redistribute terrain
     if( time_tick_ % 2048 == 0 )
@@ -1079,11 +1157,19 @@ void Map::simulate_environment()
 
 void Map::simulate()
 {
-    if( time_tick_ == 0 ) randomize();
+    // Reseed so that the simulation does not depend on how many random
+    // numbers other threads used up before the first tick
+    if( time_tick_ == 0 ) randomize( seed_ );
     ++time_tick_;
     simulate_environment();
     simulate_military();
 
+    // Money changes in too many places to track, so it's mixed in here
+    tick_hash_ = hash_ ^ hash_mix( HashMoney, money );
+
+    // Hand a copy of the world to the rewind buffer, once a day
+    rewind_buffer.capture( *this );
+
 #if 0
     // I tried out a train but never figured out where to put it in
     // the game, so it's commented out.
@@ -584,22 +584,28 @@ void WorldMapWindow::update()
                    text12i, 0x00, 0xff );
     }
 
-    // Now draw all the blobs
-    for( vector<Unit*>::iterator u = map->units.begin();
-         u != map->units.end(); ++u )
+    // Now draw all the blobs.  The simulation changes live_units while
+    // it holds unit_mutex; if it's busy for long, skip them this time.
     {
-        Unit* unit = *u;
-        if( unit->dead() ) continue;
-
-        // Draw a little red rectangle at each blob location
-        HexCoord h(unit->hexloc());
-        for( int dm = -1; dm <= 1; ++dm )
-            for( int dn = -1; dn <= 1; ++dn )
+        Mutex::Lock lock( map->unit_mutex, 500 );
+        if( lock.locked() )
+            for( vector<Unit*>::iterator u = map->live_units.begin();
+                 u != map->live_units.end(); ++u )
             {
-                int m = h.m + dm;
-                int n = h.n + dn;
-                if( m >= 0 && m < MAP_SIZE_X && n >= 0 && n < MAP_SIZE_Y )
-                    pb->row(n)[m] = 0xf9; // 0xfd ?
+                Unit* unit = *u;
+                if( unit->dead() ) continue;
+
+                // Draw a little red rectangle at each blob location
+                HexCoord h(unit->hexloc());
+                for( int dm = -1; dm <= 1; ++dm )
+                    for( int dn = -1; dn <= 1; ++dn )
+                    {
+                        int m = h.m + dm;
+                        int n = h.n + dn;
+                        if( m >= 0 && m < MAP_SIZE_X &&
+                            n >= 0 && n < MAP_SIZE_Y )
+                            pb->row(n)[m] = 0xf9; // 0xfd ?
+                    }
             }
     }
     
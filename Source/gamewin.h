@@ -64,6 +64,9 @@ class GameWindow: public CustomWindow
     TID view_thread_id;
     TID init_thread_id;
     TID simulate_thread_id;
+    TID rewind_thread_id;
+    TID planner_thread_id;
+    TID landmark_thread_id;
     int update_thread( int );
 
     void update_build_menu();
@@ -81,6 +84,7 @@ class GameWindow: public CustomWindow
     bool create_rain(int);
     bool create_fire(int);
     bool create_road(int);
+    bool rewind_day(int);
     
     bool erase_map(int);
     
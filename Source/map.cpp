@@ -22,6 +22,7 @@
 NEIGHBOR_DECL;
 
 vector<Unit*> Map::units;
+vector<Unit*> Map::live_units;
 vector<WatchtowerFire> Map::watchtowers_;
 vector<HexCoord> Map::selected;
 HexCoord Map::select_begin, Map::select_end;
@@ -50,22 +51,33 @@ static void initialize_order()
 }
 
 //////////////////////////////////////////////////////////////////////
-Map::Map()
+Map::Map( unsigned long seed )
     : terrain_(Canal), altitude_(NUM_TERRAIN_TILES-1), water_(0),
-      damage_(0), time_tick_(0), nearest_market_(0),
+      damage_(0), time_tick_(0), rewinds_(0), nearest_market_(0),
       C_land_value_(0), R_land_value_(0), A_land_value_(0),
       extra_(0), moisture_(0), prefs_(0), 
       labor_(0), total_working(0), total_labor(0), total_jobs(0),
       food_(0), total_food(0), total_fed(0), flags_(0),
       game_speed(40), drought(false), heat_(0), 
       volcano_(0,0), volcano_time_(0), histogram_disturbed(0),
-      temp_(0), occupied_(-1), city_center_(MSize/2,NSize/2),
-      num_fires_(0), num_trees_(0), num_jobs_(0)
+      temp_(0), occupied_(-1), occupants_(0), city_center_(MSize/2,NSize/2),
+      num_fires_(0), num_trees_(0), num_jobs_(0), fire_slot_(-1),
+      hash_(0), tick_hash_(0),
+      sector_sleeping(true), sleeping_(true), sector_active_(0),
+      asleep_(false), num_asleep_(0),
+      level_of_detail(false), view_left_(0), view_bottom_(0),
+      view_right_(MSize), view_top_(NSize), lod_on_(false),
+      lod_left_(0), lod_bottom_(0), lod_right_(MSize), lod_top_(NSize),
+      lod_(1),
+      cost_version_(0), edge_costs_(EdgeCosts()), edge_dirty_(1),
+      edge_div_(-1), path_reservations(false), reserving_(false),
+      seed_( seed? seed : (unsigned long)(time(NULL)) )
 {
-    randomize();
+    randomize( seed_ );
     initialize_order();
 
     units.reserve(1000);
+    live_units.reserve(1000);
     water_sources_ = new HexCoord[NUM_WATER_SOURCES];
     for( int m = 1; m <= Map::MSize; ++m )
         for( int n = 1; n <= Map::NSize; ++n )
@@ -74,6 +86,13 @@ Map::Map()
             terrain_[h] = Clear;
             flags_[h] = FLAG_EROSION;
         }
+    rebuild_terrain_sets();
+    for( int t = 0; t < maxTerrain; ++t )
+    {
+        for( int s = 0; s < NUM_SECTORS; ++s )
+            terrain_version_[t][s] = 0;
+        feature_fields_[t] = NULL;
+    }
 
     for( int k = 0; k < NUM_WATER_SOURCES; ++k )
     {
@@ -88,11 +107,13 @@ Map::Map()
         water_sources_[k] =
             HexCoord( m0 + int(rm*cos(angle)), n0 + int(rn*sin(angle)) );
     }
+    recompute_hash();
 }
 
 Map::~Map()
 {
     delete[] water_sources_;
+    forget_features();
 }
 
 void Map::damage_neighboring( const HexCoord& h, Terrain terr )
@@ -130,6 +151,66 @@ struct MapCmp
     { return f.location == h; }
 };
             
+inline int unit_tile( const HexCoord& h )
+{
+    return (h.m/Map::UNIT_TILE)*Map::UNIT_TILES_N + h.n/Map::UNIT_TILE;
+}
+
+void Map::file_unit( int pos, const HexCoord& h )
+{
+    unit_tiles_[unit_tile(h)].push_back( pos );
+}
+
+void Map::unfile_unit( int pos, const HexCoord& h )
+{
+    vector<int>& tile = unit_tiles_[unit_tile(h)];
+    for( int i = 0; i < tile.size(); ++i )
+        if( tile[i] == pos )
+        {
+            tile[i] = tile.back();
+            tile.pop_back();
+            return;
+        }
+}
+
+void Map::units_near( int m0, int n0, int m1, int n1, vector<Unit*>& found )
+{
+    int tm0 = max( 0, m0 ) / UNIT_TILE, tn0 = max( 0, n0 ) / UNIT_TILE;
+    int tm1 = min( int(MSize+1), m1 ) / UNIT_TILE;
+    int tn1 = min( int(NSize+1), n1 ) / UNIT_TILE;
+    for( int tm = tm0; tm <= tm1; ++tm )
+        for( int tn = tn0; tn <= tn1; ++tn )
+        {
+            const vector<int>& tile = unit_tiles_[tm*UNIT_TILES_N + tn];
+            for( int i = 0; i < tile.size(); ++i )
+                found.push_back( units[tile[i]] );
+        }
+}
+
+void Map::add_fire( const HexCoord& h )
+{
+    if( fire_slot_[h] != -1 )
+        return;
+    vector<HexCoord>& list = fires_[sector(h)];
+    fire_slot_[h] = list.size();
+    list.push_back( h );
+}
+
+void Map::remove_fire( const HexCoord& h )
+{
+    int i = fire_slot_[h];
+    if( i == -1 )
+        return;
+
+    // Move the last fire in the list into this one's place
+    vector<HexCoord>& list = fires_[sector(h)];
+    HexCoord last = list.back();
+    list[i] = last;
+    fire_slot_[last] = i;
+    list.pop_back();
+    fire_slot_[h] = -1;
+}
+
 void Map::set_terrain( const HexCoord& h, Terrain terr )
 {
     CHECK_VALIDITY(h);
@@ -157,12 +238,14 @@ void Map::set_terrain( const HexCoord& h, Terrain terr )
         {
             // Erasing fire decreases the fire count
             --num_fires_[sector(h)];
+            remove_fire( h );
         }
         else if( terr == Fire )
         {
             // Adding fire increases the fire count
             // (Note -- it's all recalculated periodically anyway)
             ++num_fires_[sector(h)];
+            add_fire( h );
         }
         
         if( terr == Canal )
@@ -172,6 +255,12 @@ void Map::set_terrain( const HexCoord& h, Terrain terr )
         }
         else
         {
+            hash_change( h, HashTerrain, hexterrain, terr );
+            cost_change( h );
+            terrain_set_[hexterrain].erase( h );
+            terrain_set_[terr].insert( h );
+            ++terrain_version_[hexterrain][sector(h)];
+            ++terrain_version_[terr][sector(h)];
             terrain_[h] = terr;
             extra_[h] = 0;
             if( terr == WatchFire )
@@ -193,6 +282,45 @@ void Map::set_terrain( const HexCoord& h, Terrain terr )
     }
 }
 
+void Map::rebuild_terrain_sets()
+{
+    for( int t = 0; t < maxTerrain; ++t )
+        terrain_set_[t].clear();
+    for( int m = 1; m <= Map::MSize; ++m )
+        for( int n = 1; n <= Map::NSize; ++n )
+        {
+            HexCoord h(m,n);
+            terrain_set_[terrain_[h]].insert( h );
+        }
+}
+
+void Map::recompute_hash()
+{
+    hash_ = 0;
+    for( int m = 1; m <= MSize; ++m )
+        for( int n = 1; n <= NSize; ++n )
+        {
+            HexCoord h(m,n);
+            hash_ ^= hash_mix( hash_key( h, HashTerrain ), terrain_[h] );
+            hash_ ^= hash_mix( hash_key( h, HashAltitude ), altitude_[h] );
+            hash_ ^= hash_mix( hash_key( h, HashWater ), water_[h] );
+            hash_ ^= hash_mix( hash_key( h, HashErosion ), erosion(h) );
+            for( int i = occupied_[h]; i != -1; i = units[i]->next_here )
+                hash_ ^= hash_mix( hash_key( h, HashUnit ), -1 )
+                    ^ hash_mix( hash_key( h, HashUnit ), i );
+        }
+    tick_hash_ = hash_ ^ hash_mix( HashMoney, money );
+}
+
+void Map::set_view_area( int left, int bottom, int right, int top )
+{
+    // Kept on the map, so that each fits in a byte of the replay log
+    view_left_ = max( 0, min( int(MSize+1), left ) );
+    view_bottom_ = max( 0, min( int(NSize+1), bottom ) );
+    view_right_ = max( 0, min( int(MSize+1), right ) );
+    view_top_ = max( 0, min( int(NSize+1), top ) );
+}
+
 int Map::year() const
 {
     return 637 + ( ( time_tick_ / TICKS_PER_DAY ) / DAYS_PER_MONTH ) / MONTHS_PER_YEAR;
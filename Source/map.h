@@ -37,6 +37,9 @@ typedef int value;
 // Player's money
 extern int money;
 
+// Ticks between heat field updates, or 0 if it's off (Heat.cpp)
+extern int heat_interval;
+
 enum Terrain { Clear,
                Road, Bridge, Farm, Wall, Houses,
                Gate, Trees, Fire, Lava, Scorched, Canal,
@@ -141,6 +144,35 @@ struct SectorArray
 #endif
         return data[sector];
     }
+
+    const T& operator [] ( int sector ) const
+    {
+#if DEVELOPMENT >= 2
+        unsigned s = unsigned(sector);
+        if( s >= NUM_SECTORS ) Throw("Invalid sector");
+#endif
+        return data[sector];
+    }
+};
+
+// A sector falls asleep when neither it nor its neighbors have had any
+// activity for this many ticks
+const int SECTOR_SLEEP_TICKS = 256;
+
+// With level of detail on, sectors two sectors away from the visible
+// area run the slow kernels at 1/LOD_NEAR_RATE of the normal rate, and
+// sectors farther away at 1/LOD_FAR_RATE
+const int LOD_NEAR_RATE = 2;
+const int LOD_FAR_RATE = 4;
+
+// Altitude differences are measured in these units by the path finder
+#define ALTITUDE_SCALE (NUM_TERRAIN_TILES/16)
+
+// The cost of a step from a hex to each of its neighbors
+struct EdgeCosts
+{
+    short cost[6];
+    EdgeCosts() { for( int d = 0; d < 6; ++d ) cost[d] = 0; }
 };
 
 inline int sector( const HexCoord& h )
@@ -187,6 +219,146 @@ inline bool operator == ( const SectorIterator& a, const SectorIterator& b )
     return a.origin == b.origin && a.i == b.i;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Bit counting and scanning on 32-bit words.  (The compiler doesn't
+// have builtins for these.)
+inline int count_bits( unsigned long x )
+{
+    x = x - ( ( x >> 1 ) & 0x55555555UL );
+    x = ( x & 0x33333333UL ) + ( ( x >> 2 ) & 0x33333333UL );
+    x = ( x + ( x >> 4 ) ) & 0x0f0f0f0fUL;
+    return int( ( ( x * 0x01010101UL ) & 0xffffffffUL ) >> 24 );
+}
+
+// Position of the lowest set bit; x must not be 0
+inline int lowest_bit( unsigned long x )
+{
+    static const char position[32] =
+    {
+        0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+        31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+    };
+    return position[ ( ( ( x & (0-x) ) * 0x077cb531UL ) & 0xffffffffUL ) >> 27 ];
+}
+
+// The hexes with one kind of terrain, one bit per hex.  Each column of
+// the map (one value of m) is a run of 32-bit words indexed by n, so
+// whole words can be counted or scanned at once.  The border hexes are
+// never in the set, so neighbors() needs no range checks.
+const int TERRAIN_SET_WORDS = ( MAP_SIZE_Y + 2 + 31 ) / 32;
+
+class TerrainSet
+{
+  public:
+    TerrainSet() { clear(); }
+
+    void clear()
+    {
+        for( int m = 0; m < MAP_SIZE_X+2; ++m )
+            for( int w = 0; w < TERRAIN_SET_WORDS; ++w )
+                bits[m][w] = 0;
+    }
+
+    void insert( const HexCoord& h ) { bits[h.m][h.n/32] |= bit(h.n); }
+    void erase( const HexCoord& h ) { bits[h.m][h.n/32] &= ~bit(h.n); }
+    bool contains( int m, int n ) const
+    { return ( bits[m][n/32] & bit(n) ) != 0; }
+    bool contains( const HexCoord& h ) const { return contains( h.m, h.n ); }
+
+    int count() const
+    {
+        int total = 0;
+        for( int m = 1; m <= MAP_SIZE_X; ++m )
+            for( int w = 0; w < TERRAIN_SET_WORDS; ++w )
+                total += count_bits( bits[m][w] );
+        return total;
+    }
+
+    // The neighbors of h that are in the set, as bits (1<<d) in
+    // HexDirection order.  This spells out the neighbors table in
+    // hexcoord.h: odd columns are shifted half a hex up.
+    int neighbors( const HexCoord& h ) const
+    {
+        int m = h.m, n = h.n, a = h.m & 1;
+        return contains( m, n+1 )
+            | ( contains( m+1, n+a ) << 1 )
+            | ( contains( m+1, n+a-1 ) << 2 )
+            | ( contains( m, n-1 ) << 3 )
+            | ( contains( m-1, n+a-1 ) << 4 )
+            | ( contains( m-1, n+a ) << 5 );
+    }
+
+    unsigned long word( int m, int w ) const { return bits[m][w]; }
+
+  private:
+    unsigned long bits[MAP_SIZE_X+2][TERRAIN_SET_WORDS];
+    static unsigned long bit( int n ) { return 1UL << ( n % 32 ); }
+};
+
+// Visits the hexes in a TerrainSet in order of m, then n (the same
+// order as the usual loop over the whole map).  Hexes may be taken out
+// of the set while it is being visited.
+class TerrainSetIterator
+{
+  public:
+    TerrainSetIterator( const TerrainSet& set_ )
+        :set(set_), m(1), w(-1), pending(0), n(0)
+    { advance(); }
+
+    bool done() const { return m > MAP_SIZE_X; }
+    HexCoord operator * () const { return HexCoord( m, n ); }
+    TerrainSetIterator& operator ++ () { advance(); return *this; }
+
+  private:
+    const TerrainSet& set;
+    int m, w;
+    unsigned long pending;      // the rest of word w of column m
+    int n;
+
+    void advance()
+    {
+        while( pending == 0 )
+        {
+            if( ++w == TERRAIN_SET_WORDS )
+            {
+                w = 0;
+                if( ++m > MAP_SIZE_X )
+                    return;
+            }
+            pending = set.word( m, w );
+        }
+        n = w*32 + lowest_bit( pending );
+        pending &= pending-1;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+// The world hash is the XOR of one mixed value per (hex, field) pair,
+// so a setter can update it by mixing out the old value and mixing in
+// the new one.  All arithmetic is kept to 32 bits so that the hash is
+// the same on every machine.
+enum HashField
+{
+    HashTerrain, HashAltitude, HashWater, HashErosion, HashUnit, HashMoney
+};
+
+inline unsigned long hash_mix( unsigned long key, long value )
+{
+    unsigned long x = ( key * 0x9e3779b1UL
+                        ^ (unsigned long)(value) * 0x85ebca6bUL ) & 0xffffffffUL;
+    x ^= x >> 15;
+    x = ( x * 0xc2b2ae35UL ) & 0xffffffffUL;
+    x ^= x >> 13;
+    return x;
+}
+
+inline unsigned long hash_key( const HexCoord& h, HashField field )
+{
+    return ( (unsigned long)(h.m | (h.n << 8)) << 3 ) | field;
+}
+
+struct FeatureField;
+
 //////////////////////////////////////////////////////////////////////
 // This is the main map structure
 // At first I thought I would support multiple maps, but I think it
@@ -201,7 +373,7 @@ struct Map
     Mutex unit_mutex;
     Mutex selection_mutex;
 
-    Map();
+    Map( unsigned long seed = 0 );   // 0 picks a seed from the clock
     ~Map();
 
     static bool valid( const HexCoord& h );
@@ -209,7 +381,7 @@ struct Map
     Terrain terrain( const HexCoord& h ) const { return terrain_[h]; }
     void set_terrain( const HexCoord& h, Terrain terrain );
     value water( const HexCoord& h ) const { return water_[h]; }
-    void set_water( const HexCoord& h, value water );
+    void set_water( const HexCoord& h, value water, bool activity = true );
     value labor( const HexCoord& h ) const { return labor_[h]; }
     void set_labor( const HexCoord& h, value labor );
     value altitude( const HexCoord& h ) const { return altitude_[h]; }
@@ -228,6 +400,7 @@ struct Map
     void super_smooth_terrain();
 
     void calculate_moisture();
+    void diffuse_heat();       // every heat_interval ticks, if it's > 0
     void smooth_terrain( int num_hexes = NUM_HEXES/15 );
     void water_flow();
     void water_from_springs();
@@ -272,10 +445,50 @@ struct Map
     void simulate_military();
     int simulation_thread(int);
     void process_commands();
+    void take_options();    // for this tick; see MapCmd.cpp
     
-    // Units
-    MapArray<short> occupied_;  // Does not need to be saved, can be
-    static vector<Unit*> units; // regenerated from units list
+    // Units.  A hex can hold more than one blob (see capacity); the
+    // first is in occupied_ and the rest are linked through next_here.
+    MapArray<int> occupied_;    // Does not need to be saved, can be
+    MapArray<byte> occupants_;  // regenerated from units list
+    static vector<Unit*> units;
+    static vector<Unit*> live_units;    // the ones alive at the last sweep,
+                                        // and the ones made since
+
+    // The blobs in each tile of UNIT_TILE x UNIT_TILE hexes, kept along
+    // with occupied_, so that the view only looks at the blobs near the
+    // part of the map it shows
+    enum { UNIT_TILE = 8 };
+    enum { UNIT_TILES_M = (MSize+1)/UNIT_TILE+1 };
+    enum { UNIT_TILES_N = (NSize+1)/UNIT_TILE+1 };
+    vector<int> unit_tiles_[UNIT_TILES_M*UNIT_TILES_N];
+    void file_unit( int pos, const HexCoord& h );
+    void unfile_unit( int pos, const HexCoord& h );
+    // Blobs in hexes m0..m1, n0..n1, and some around them
+    void units_near( int m0, int n0, int m1, int n1, vector<Unit*>& found );
+
+    // How many blobs fit in a hex.  Blobs can pass each other on roads.
+    int capacity( const HexCoord& h ) const
+    {
+        Terrain t = terrain_[h];
+        return ( t == Road )? 3 : ( t == Bridge )? 2 : 1;
+    }
+    bool has_room( const HexCoord& h ) const
+    { return occupants_[h] < capacity( h ); }
+
+    // Is h too full for unit to step into?  Blobs that are moving will
+    // probably be gone by then, so they only count if all is set.
+    bool blocked( const HexCoord& h, const Unit* unit, bool all )
+    {
+        int i = occupied_[h];
+        if( i == -1 )
+            return false;
+        int others = 0;
+        for( ; i != -1; i = units[i]->next_here )
+            if( units[i] != unit && ( all || !units[i]->moving() ) )
+                ++others;
+        return others >= capacity( h );
+    }
 
     // Watchtowers
     static vector<WatchtowerFire> watchtowers_;
@@ -314,6 +527,16 @@ struct Map
     }
 
     int residents( const HexCoord& h ) const;
+
+    // World hash, covering terrain, altitude, water, units, and money.
+    // The setters keep hash_ up to date; tick_hash() is the value at the
+    // end of the last tick, and is what replay logs and peers compare.
+    unsigned long hash_;
+    unsigned long tick_hash_;
+    unsigned long tick_hash() const { return tick_hash_; }
+    void hash_change( const HexCoord& h, HashField field,
+                      long old_value, long new_value, bool activity = true );
+    void recompute_hash();         // full rescan, after bulk changes
     
     // private:
     MapArray<Terrain> terrain_;
@@ -331,12 +554,91 @@ struct Map
     MapArray<long> C_land_value_, R_land_value_, A_land_value_;
     HexCoord *water_sources_; // array
     long time_tick_;
+    long rewinds_;              // bumped when time goes backwards (Rewind.h)
+    unsigned long seed_;        // the world is rebuilt exactly from this
     friend class View;
 
     SectorArray<byte> num_fires_;
     SectorArray<byte> num_trees_; // only those old enough to be cut down
     SectorArray<byte> num_jobs_; // for builders
     void collect_sector_statistics();
+
+    // The hexes on fire in each sector, kept up to date by set_terrain
+    // so that firefighters don't have to look at every hex.  Each fire's
+    // position in its list is in fire_slot_, for removing it quickly.
+    vector<HexCoord> fires_[NUM_SECTORS];
+    MapArray<short> fire_slot_;
+    void add_fire( const HexCoord& h );
+    void remove_fire( const HexCoord& h );
+
+    // The hexes of each kind of terrain, kept up to date by set_terrain
+    TerrainSet terrain_set_[maxTerrain];
+    const TerrainSet& hexes( Terrain t ) const { return terrain_set_[t]; }
+    void rebuild_terrain_sets();        // after terrain_ is replaced
+
+    // terrain_version_[t][s] is bumped whenever set_terrain adds or
+    // removes terrain t in sector s.  The feature fields (see
+    // FeatureField.h) are checked against it, and are made the first
+    // time nearest() is asked about each kind of terrain.
+    long terrain_version_[maxTerrain][NUM_SECTORS];
+    FeatureField* feature_fields_[maxTerrain];
+    FeatureField* feature_field( Terrain t );
+    HexCoord nearest( const HexCoord& h, Terrain t ); // (0,0) if there's none
+    int nearest_distance( const HexCoord& h, Terrain t ); // steps, or -1
+    void forget_features();
+
+    // Sector sleeping.  Any change that reaches the world hash counts as
+    // activity (except evaporation, so that still water can sleep), and
+    // so does fire, lava, a blob, or a job anywhere in the sector (found
+    // by collect_sector_statistics).  The per-hex kernels skip hexes in
+    // sleeping sectors, except evaporation, which runs everywhere.
+    Subject<bool> sector_sleeping;      // option
+    bool sleeping_;                     // sector_sleeping this tick
+    SectorArray<long> sector_active_;   // last tick with activity
+    SectorArray<bool> asleep_;          // recalculated every tick
+    int num_asleep_;
+    void wake( const HexCoord& h ) { sector_active_[sector(h)] = time_tick_; }
+    bool asleep( const HexCoord& h ) const { return asleep_[sector(h)]; }
+    void update_sleeping();
+
+    // Level of detail.  When it is on, sectors far from the part of the
+    // map on screen run smooth_terrain, tree aging, and calculate_prefs
+    // less often; smooth_terrain and tree aging take bigger steps to
+    // make up for it.  Water and the economy always run at full rate,
+    // so their totals are not affected.
+    Subject<bool> level_of_detail;      // option
+    int view_left_, view_bottom_, view_right_, view_top_; // hexes on screen
+    bool lod_on_;                       // level_of_detail this tick
+    int lod_left_, lod_bottom_, lod_right_, lod_top_;     // view this tick
+    SectorArray<byte> lod_;             // hexes are visited 1 pass in lod_
+    void set_view_area( int left, int bottom, int right, int top );
+    void update_lod();
+    int lod( const HexCoord& h ) const { return lod_[sector(h)]; }
+    bool lod_skip( const HexCoord& h, int pass ) const
+    {
+        int k = lod(h);
+        return k > 1 && ( pass + sector(h) ) % k != 0;
+    }
+
+    // Movement costs.  cost_version_ is bumped whenever something that
+    // the path finder's costs depend on changes in a sector: the
+    // terrain, whether there is water, or the altitude (in units of
+    // ALTITUDE_SCALE).  Cached path data is checked against it.
+    SectorArray<long> cost_version_;
+    void cost_change( const HexCoord& h );
+
+    // The path finder's cache of step costs out of each hex, ignoring
+    // blobs, for path_div == edge_div_.  A row is marked dirty when its
+    // hex or a neighbor has a cost change, and rebuilt before the next
+    // batch of searches (prepare_edge_costs).
+    MapArray<EdgeCosts> edge_costs_;
+    MapArray<byte> edge_dirty_;
+    int edge_div_;
+
+    // Blobs reserve the hexes they're about to walk through, and other
+    // blobs' paths avoid them (see Reservations.h)
+    Subject<bool> path_reservations;    // option
+    bool reserving_;                    // path_reservations this tick
 };
 
 inline bool Map::valid( const HexCoord& h )
@@ -356,12 +658,36 @@ inline int Map::residents( const HexCoord& h ) const
     return ( valid(h) && terrain(h) == Houses )? (15 + 10*(extra_[h])) : 0;
 }
 
-inline void Map::set_water( const HexCoord& h, value water )
+inline void Map::hash_change( const HexCoord& h, HashField field,
+                              long old_value, long new_value, bool activity )
+{
+    unsigned long key = hash_key( h, field );
+    hash_ ^= hash_mix( key, old_value ) ^ hash_mix( key, new_value );
+    if( activity )
+        wake( h );
+}
+
+inline void Map::cost_change( const HexCoord& h )
+{
+    ++cost_version_[sector(h)];
+    edge_dirty_[h] = 1;
+    for( int d = 0; d < 6; ++d )
+    {
+        HexCoord h2 = Neighbor( h, HexDirection(d) );
+        if( valid(h2) )
+            edge_dirty_[h2] = 1;
+    }
+}
+
+inline void Map::set_water( const HexCoord& h, value water, bool activity )
 {
     CHECK_VALIDITY(h);
     int old_water = water_[h];
     if( water != old_water )
     {
+        hash_change( h, HashWater, old_water, water, activity );
+        if( (water > 0) != (old_water > 0) )
+            cost_change( h );
         water_[h] = water;
         damage_[h] = time_tick_+1;
     }
@@ -379,6 +705,9 @@ inline void Map::set_altitude( const HexCoord& h, value altitude )
     int old_altitude = altitude_[h];
     if( altitude != old_altitude )
     {
+        hash_change( h, HashAltitude, old_altitude, altitude );
+        if( altitude/ALTITUDE_SCALE != old_altitude/ALTITUDE_SCALE )
+            cost_change( h );
         altitude_[h] = altitude;
         damage_[h] = time_tick_+1;
     }
@@ -393,6 +722,8 @@ inline void Map::set_moisture( const HexCoord& h, value moisture )
 inline void Map::set_erosion( const HexCoord& h, bool erosion )
 {
     CHECK_VALIDITY(h);
+    if( erosion != ( (flags_[h] & FLAG_EROSION) != 0 ) )
+        hash_change( h, HashErosion, !erosion, erosion );
     if( erosion )
         flags_[h] |= FLAG_EROSION;
     else
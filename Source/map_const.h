@@ -30,3 +30,7 @@ const int WATER_MULT = 6;    // How much water per unit of altitude
 const int WALL_HEIGHT = 40;
 const int CANAL_DEPTH = -22;
 const int TREE_MATURITY = 5;
+
+// Heat field (see Heat.cpp)
+const int HEAT_FIRE = 2000;             // held at every burning hex
+const int HEAT_ALARM = HEAT_FIRE / 64;  // a fire within about ten hexes
@@ -15,11 +15,17 @@
 #include "Notion.h"
 #include "Map.h"
 #include "Path.h"
+#include "PathPlanner.h"
+#include "Reservations.h"
+#include "JobIndex.h"
 #include "Map_Const.h"
 
 #include <algo.h>
 
-const int heat_threshold = 2000;
+const int heat_threshold = HEAT_FIRE;
+
+// Fires at least this far away (10 hexes) are reached by flow field
+const int FLOW_MIN_DISTANCE = 100;
 int heat_pref( int h )
 {
     if( h <= heat_threshold )
@@ -181,15 +187,36 @@ void Map::simulate_military()
     if( !lock.locked() )
         return;
 
+    // Blobs that died last tick can be made again
+    Unit::sweep( this );
+
+    // Blobs pick up the paths that were planned at the end of last tick
+    reservations.expire( time_tick_ );
+    path_planner.deliver( *this );
+
     // Count the blobs in each sector
     SectorArray<int> blobs_in_sector(0);
-    for( vector<Unit*>::iterator u = units.begin(); u != units.end(); ++u )
+    for( vector<Unit*>::iterator u = live_units.begin();
+         u != live_units.end(); ++u )
     {
         Unit& unit( **u );
         if( !unit.dead() && valid(unit.final_dest) && unit.type == Unit::Firefighter )
             ++blobs_in_sector[sector(unit.final_dest)];
     }
 
+    // The sectors with fires, in order of the best ranking any blob
+    // could give them (one right next to them, with one fewer blob going
+    // there), so that a blob can stop looking once the rest can't win
+    vector< pair<int,int> > burning;    // -best ranking, sector
+    for( int s = 0; s < NUM_SECTORS; ++s )
+        if( num_fires_[s] > 0 )
+        {
+            int others = max( 0, blobs_in_sector[s]-1 );
+            burning.push_back( pair<int,int>(
+                -( num_fires_[s]/( 1 + 8*others ) ), s ) );
+        }
+    sort( burning.begin(), burning.end() );
+
     // Create new firefighters
     for( vector<WatchtowerFire>::iterator fi = watchtowers_.begin();
          fi != watchtowers_.end(); ++fi )
@@ -202,22 +229,25 @@ void Map::simulate_military()
         }
         else
         {
-            // Scan nearby area
+            // The heat field tells us whether there's a fire nearby; if
+            // it's turned off, look for fires in the nearby sectors.
+            // Scan the nearby sectors for blobs already going there.
             const int D = 10;
-            bool fires = false, blobs = false;
+            bool fires = heat_interval > 0 && heat_[h] > HEAT_ALARM;
+            bool blobs = false;
             for( int m = h.m-D; m <= h.m+D; m += D )
                 for( int n = h.n-D; n <= h.n+D; n += D )
                 {
                     HexCoord h2(m,n);
                     if( !valid(h2) ) continue;
 
-                    if( num_fires_[sector(h2)] > 0 )
+                    if( heat_interval <= 0 && num_fires_[sector(h2)] > 0 )
                         fires = true;
                     if( blobs_in_sector[sector(h2)] > 0 )
                         blobs = true;
                 }
 
-            if( fires && !blobs && occupied_[h] == -1 )
+            if( fires && !blobs && has_room( h ) )
             {
                 Unit* unit = Unit::make( this, Unit::Firefighter, h );
                 unit->home = h;
@@ -227,7 +257,8 @@ void Map::simulate_military()
     }
 	
     // Move military units around
-    for( vector<Unit*>::iterator u = units.begin(); u != units.end(); ++u )
+    for( vector<Unit*>::iterator u = live_units.begin();
+         u != live_units.end(); ++u )
     {
         Unit& unit( **u );
         if( unit.dead() ) continue;
@@ -244,7 +275,8 @@ void Map::simulate_military()
             unit.stop();
         }
 
-        if( !unit.moving() && unit.type == Unit::Firefighter )
+        if( !unit.moving() && !unit.planning()
+            && unit.type == Unit::Firefighter )
         {
             HexCoord h( unit.hexloc() );
 
@@ -258,8 +290,10 @@ void Map::simulate_military()
                 best_dist = 0;
             }
             else
-                for( int s = 0; s < NUM_SECTORS; ++s )
+                for( int k = 0; k < burning.size()
+                         && -burning[k].first >= best_ranking; ++k )
                 {
+                    int s = burning[k].second;
                     if( num_fires_[s] > 0 )
                     {
                         int blobs_here = blobs_in_sector[s];
@@ -268,7 +302,8 @@ void Map::simulate_military()
                         int ranking =
                             num_fires_[s]/( 1 + 8*blobs_here ) - dist*dist/128;
                     
-                        if( ranking > best_ranking )
+                        if( ranking > best_ranking
+                            || ( ranking == best_ranking && s < best_s ) )
                         {
                             best_ranking = ranking;
                             best_s = s;
@@ -282,26 +317,29 @@ void Map::simulate_military()
                 // Okay, let's go to this sector
                 if( best_dist > SECTOR_X_SIZE+SECTOR_Y_SIZE )
                 {
-                    // If the sector is far away, go to the center of it
-                    unit.set_dest( this, sector_center(best_s) );
+                    // If the sector is far away, go to the center of it,
+                    // along with everyone else heading there
+                    unit.set_dest( this, sector_center(best_s), true );
                 }
                 else
                 {
-                    // Find the nearest hex with a fire
+                    // Find the nearest hex with a fire in the sector.
+                    // Ties go to the lowest (m,n).
                     HexCoord closest_h(h);
                     int closest_dist = INT_MAX;
-                    for( SectorIterator sh = sector_begin(best_s);
-                         sh != sector_end(best_s); ++sh )
+                    const vector<HexCoord>& fires = fires_[best_s];
+                    for( int f = 0; f < fires.size(); ++f )
                     {
-                        HexCoord hj(*sh);
-                        if( terrain(hj) == Fire )
+                        HexCoord hj( fires[f] );
+                        int dist = hex_distance(h, hj);
+                        if( dist < closest_dist
+                            || ( dist == closest_dist
+                                 && ( hj.m < closest_h.m
+                                      || ( hj.m == closest_h.m
+                                           && hj.n < closest_h.n ) ) ) )
                         {
-                            int dist = hex_distance(h, hj);
-                            if( dist < closest_dist )
-                            {
-                                closest_dist = dist;
-                                closest_h = hj;
-                            }
+                            closest_dist = dist;
+                            closest_h = hj;
                         }
                     }
                 
@@ -311,7 +349,8 @@ void Map::simulate_military()
                         num_fires_[best_s] = 0;
                     }
                     else
-                        unit.set_dest( this, closest_h );
+                        unit.set_dest( this, closest_h,
+                                       closest_dist >= FLOW_MIN_DISTANCE );
                 }
             }
             else
@@ -324,11 +363,11 @@ void Map::simulate_military()
                         // The unit can go back in, so kill it (set id to -1)
                         unit.die(this);
                     }
-                    else if( watchtowers_.size() > 0 )
+                    else if( valid( nearest( h, WatchFire ) ) )
                     {
-                        // The unit's home is gone but it could go to another
-                        // place
-                        unit.home = watchtowers_[0].location;
+                        // The unit's home is gone but it could go to the
+                        // nearest other watchtower
+                        unit.home = nearest( h, WatchFire );
                     }
                 }
                 else if( valid(unit.home) && h != unit.home )
@@ -340,6 +379,12 @@ void Map::simulate_military()
             }
         }
     }
+
+    // Give out jobs to the builders that asked for them
+    job_index.assign( this );
+
+    // Find paths for all the blobs that asked for one this tick
+    path_planner.plan( *this );
 }
 #endif
 
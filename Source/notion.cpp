@@ -17,6 +17,8 @@
 #include "Notion.h"
 #include "Figment.h"
 
+unsigned long random_seed = 1;
+
 int solid( PS& ps, Color rgb )
 {
     return GpiQueryNearestColor( ps, 0, rgb );
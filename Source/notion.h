@@ -172,20 +172,31 @@ class EventSem
     HEV handle_;
 };
 
+// The simulation uses its own generator instead of rand(), so that the
+// same seed produces the same world on every compiler and C library.
+// Replays (see Replay.h) depend on this.
+extern unsigned long random_seed;
+
 template<int shift>
 struct Random
 {
     static inline int generate( int range )
     {
-        return range >= 0 ? int(rand()%range) : 0;
+        random_seed = random_seed * 1103515245UL + 12345UL;
+        return range >= 0 ? int(((random_seed >> 8) & 0xffffffUL)%range) : 0;
     }
 };
 
 #define M_PI 3.1415926
+inline void randomize( unsigned long seed )
+{
+    random_seed = seed;
+}
+
 inline void randomize()
 {
     // Transition -- Borland provided randomize() but GCC & CSet did not.
-    srand(unsigned(time(NULL)));
+    randomize( (unsigned long)(time(NULL)) );
 }
 
 inline int ShortRandom( int range ) { return Random<16>::generate(range); }
@@ -251,6 +251,14 @@ int ViewWindow::painter_thread(int)
                     ;
             }
 
+            // Tell the simulation which part of the map is on screen
+            {
+                int left, bottom, right, top;
+                View::rect_to_hexarea( view->view_area( area ),
+                                       left, bottom, right, top );
+                map->set_view_area( left, bottom, right, top );
+            }
+
             DamageArea to_paint( clipping );
 
             if( paint_full || update_full )
@@ -21,6 +21,9 @@
 #include "Map.h"
 
 #include "Path.h"
+#include "PathGraph.h"
+#include "Landmarks.h"
+#include "Reservations.h"
 
 // Let's create some typedefs so that we can change which data
 // structures are being used.  In the future, these will be
@@ -31,17 +34,76 @@ typedef HexDirection Direction;
 // The mark array marks directions on the map.  The direction points
 // to the spot that is the previous spot along the path.  By starting
 // at the end, we can trace our way back to the start, and have a path.
-// It also stores 'f' values for each space on the map.  These are used
-// to determine whether something is in OPEN or not.  It stores 'g'
-// values to determine whether costs need to be propagated down.
+// It also stores the position of each OPEN node in the heap.  This is
+// used to determine whether something is in OPEN or not, and to find
+// it in the heap without searching.  It stores 'g' values to determine
+// whether costs need to be propagated down.
 struct Marking
 {
     HexDirection direction:3;   // !DirNone means OPEN || CLOSED
-    int f:14;                   // >= 0 means OPEN
     int g:14;                   // >= 0 means OPEN || CLOSED
-    Marking(): direction(DirNone), f(-1), g(-1) {}
+    short index;                // >= 0 means OPEN (position in the heap)
+    unsigned short epoch;       // the search that wrote this marking
+    Marking(): direction(DirNone), g(-1), index(-1), epoch(0) {}
 };
-static MapArray<Marking>& mark = *(new MapArray<Marking>(Marking()));
+
+// Each search gets its own mark array, so that searches on different
+// threads don't need a lock.  Clearing the array after a search would
+// take as long as the search, so instead every search has a new epoch
+// number, and a marking left over from an older epoch reads as blank.
+// Contexts are kept in a pool and reused; there are only as many as
+// there have been simultaneous searches.
+struct SearchContext
+{
+    MapArray<Marking> marks;
+    unsigned short epoch;
+
+    SearchContext(): marks(Marking()), epoch(1) {}
+
+    Marking& operator [] ( const HexCoord& h )
+    {
+        Marking& M = marks[h];
+        if( M.epoch != epoch )
+        {
+            M = Marking();
+            M.epoch = epoch;
+        }
+        return M;
+    }
+
+    void next_epoch();
+};
+
+void SearchContext::next_epoch()
+{
+    if( ++epoch == 0 )
+    {
+        // The epoch wrapped around, so old markings could look current
+        for( int m = 1; m <= Map::MSize; ++m )
+            for( int n = 1; n <= Map::NSize; ++n )
+                marks[HexCoord(m,n)] = Marking();
+        epoch = 1;
+    }
+}
+
+static vector<SearchContext*> free_contexts;
+static Mutex context_mutex;     // held only to take or return a context
+
+static SearchContext* acquire_context()
+{
+    Mutex::Lock lock( context_mutex );
+    if( free_contexts.empty() )
+        return new SearchContext;
+    SearchContext* c = free_contexts.back();
+    free_contexts.pop_back();
+    return c;
+}
+
+static void release_context( SearchContext* c )
+{
+    Mutex::Lock lock( context_mutex );
+    free_contexts.push_back( c );
+}
 
 // Path_div is used to modify the heuristic.  The lower the number,
 // the higher the heuristic value.  This gives us worse paths, but
@@ -51,10 +113,6 @@ static MapArray<Marking>& mark = *(new MapArray<Marking>(Marking()));
 // search for.
 Subject<int> path_div(6);
 
-// Since this module is being used in a multithreaded program,
-// we lock the global data structures used by A*:
-static Mutex astar_mutex;
-
 struct Node
 {
     Location loc;   // location on the map, in hex coordinates
@@ -93,20 +151,17 @@ inline Direction ReverseDirection(Direction d)
     return HexDirection( ( 3+int(d) ) % 6 );
 }
 
-// greater<Node> is an STL thing to create a 'comparison' object out of
-// the greater-than operator, and call it comp.
-greater<Node> comp;
-
 // Let's define our priority queue implementation.
-// I'm using a priority queue implemented as a heap.  STL has some nice
-// heap manipulation functions.  (Look at the source to `priority_queue'
-// for details.)  I didn't use priority_queue because later on, I need
-// to traverse the entire data structure to update certain elements; the
-// abstraction layer on priority_queue wouldn't let me do that.
+// I'm using a priority queue implemented as a binary heap.  I used to
+// use STL's push_heap and pop_heap, but when a node's g value improved
+// I had to search the entire heap to find it.  Now the heap is kept by
+// hand, and every time a node moves in the heap, its position is written
+// into the mark array.  Finding a node in OPEN is then an array lookup,
+// and decreasing its key is O(log n).
 typedef vector<Node> Container;
 
 // * Things in OPEN are in the open container (which is a heap),
-//   and also their mark[...].f value is nonnegative.
+//   and also their mark[...].index value is their position in it.
 // * Things in CLOSED are in the visited container (which is unordered),
 //   and also their mark[...].direction value is not DirNone.
 class PriorityQueue
@@ -116,8 +171,9 @@ class PriorityQueue
     // which nodes we visited, so that we can clear the mark array
     // at the end.  This is the 'CLOSED' set plus the 'OPEN' set.
     Container open, visited;
+    SearchContext& mark;
 
-    PriorityQueue() {}
+    PriorityQueue( SearchContext& context ): mark(context) {}
     ~PriorityQueue() {}
 
     void reset();
@@ -126,28 +182,34 @@ class PriorityQueue
     
     inline void insert(Node& N, Direction dir = DirNone)
     {
-        // Now add this node to OPEN
-        open.push_back(N);
-        push_heap(open.begin(), open.end(), comp);
-        
         // Add this node to VISITED (OPEN|CLOSED) if it's not already there:
         if( !is_visited(N.loc) )
             visited.push_back(N);
 
         // Set the marking array to indicate that the node is OPEN
         mark[N.loc].direction = dir;
-        mark[N.loc].f = N.g+N.h;
         mark[N.loc].g = N.g;
+
+        // Now add this node to OPEN
+        open.push_back(N);
+        sift_up(open.size()-1);
     }
     
     void get_first(Node& N)
     {
         N = open.front();
-        pop_heap(open.begin(), open.end(), comp);
-        open.pop_back();
 
         // This node is no longer in open:
-        mark[N.loc].f = -1;
+        mark[N.loc].index = -1;
+
+        // Move the last node to the top and let it find its place
+        Node last = open.back();
+        open.pop_back();
+        if( !open.empty() )
+        {
+            place(0, last);
+            sift_down(0);
+        }
     }
 
     Container::iterator find_in_open(const HexCoord& h);
@@ -159,7 +221,7 @@ class PriorityQueue
     
     inline bool is_open(const HexCoord& h)
     {
-        return mark[h].f != -1;
+        return mark[h].index != -1;
     }
 
     inline int g_value(const HexCoord& h)
@@ -170,18 +232,60 @@ class PriorityQueue
     }
 
     Node decrease_key(const HexCoord& h, int new_g, Direction dir);
+
+  private:
+    inline void place(int i, const Node& N)
+    {
+        open[i] = N;
+        mark[N.loc].index = i;
+    }
+
+    // The best node (lowest f, ties broken by lowest h) is at the top
+    void sift_up(int i);
+    void sift_down(int i);
 };
 
+void PriorityQueue::sift_up(int i)
+{
+    Node N = open[i];
+    while( i > 0 )
+    {
+        int parent = (i-1)/2;
+        if( !(N < open[parent]) )
+            break;
+        place(i, open[parent]);
+        i = parent;
+    }
+    place(i, N);
+}
+
+void PriorityQueue::sift_down(int i)
+{
+    Node N = open[i];
+    int size = open.size();
+    for(;;)
+    {
+        int child = 2*i+1;
+        if( child >= size )
+            break;
+        if( child+1 < size && open[child+1] < open[child] )
+            ++child;
+        if( !(open[child] < N) )
+            break;
+        place(i, open[child]);
+        i = child;
+    }
+    place(i, N);
+}
+
 Container::iterator PriorityQueue::find_in_open(const HexCoord& hn)
 {
-    // Only search for this node if we know it's in the OPEN set
+    // Only look for this node if we know it's in the OPEN set
     if( Map::valid(hn) && is_open(hn) ) 
     {
-        for( Container::iterator i = open.begin(); i != open.end(); ++i )
-        {
-            if( (*i).loc == hn )
-                return i;
-        }
+        Container::iterator i = open.begin() + mark[hn].index;
+        Assert( (*i).loc == hn );
+        return i;
     }
     return open.end();
 }
@@ -192,35 +296,23 @@ Node PriorityQueue::decrease_key(const HexCoord& h, int new_g, Direction dir)
     Assert( i != open.end() );
     Assert( g_value(h) == (*i).g );
     
-    // Push this thing UP in the heap (only up allowed!)
-    (*i).g = new_g;
-    push_heap(open.begin(), i+1, comp);
-    
     // Set its direction to the parent node
     mark[h].g = new_g;
-    mark[h].f = new_g + (*i).h;
     mark[h].direction = dir;
 
-    return (*i);
+    // Push this thing UP in the heap (only up allowed!)
+    (*i).g = new_g;
+    Node N = (*i);
+    sift_up(i - open.begin());
+    return N;
 }
                     
 void PriorityQueue::reset()
 {
-    // Erase the mark array, for all items in open or visited
-    for( Container::iterator o = open.begin(); o != open.end(); ++o )
-    {
-        HexCoord h = (*o).loc;
-        mark[h].direction = DirNone;
-        mark[h].f = -1;
-        mark[h].g = -1;
-    }
-    for( Container::iterator v = visited.begin(); v != visited.end(); ++v )
-    {
-        HexCoord h = (*v).loc;
-        mark[h].direction = DirNone;
-        mark[h].g = -1;
-        Assert( !is_open( h ) );
-    }
+    // The mark array is cleared by moving on to the next epoch
+    open.erase( open.begin(), open.end() );
+    visited.erase( visited.begin(), visited.end() );
+    mark.next_epoch();
 }
     
 // Here's the class that implements A*.  I take a map, two points
@@ -231,13 +323,14 @@ struct AStar
 {
     PathStats stats;
     Heuristic& heuristic;
+    SearchContext* context;
     PriorityQueue pq;
     Map& map;
     HexCoord source, destination;
-    Mutex::Lock lock;
     
     AStar(Heuristic& h, Map& m, HexCoord a, HexCoord b)
-        : heuristic(h), map(m), source(a), destination(b), lock(astar_mutex) {}
+        : heuristic(h), context(acquire_context()), pq(*context),
+          map(m), source(a), destination(b) {}
     ~AStar();
 
     // Main function:
@@ -252,6 +345,7 @@ template<class Heuristic>
 AStar<Heuristic>::~AStar()
 {
     pq.reset();
+    release_context( context );
 }
 
 // This is the 'propagate down' stage of the algorithm, which I'm not
@@ -349,6 +443,8 @@ void AStar<Heuristic>::find_path(vector<HexCoord>& path)
                 continue;
 
             int k = heuristic.kost(map, N.loc, d, hn);
+            if( k < MAXIMUM_PATH_LENGTH )
+                k += heuristic.delay(map, hn, N.g + k);
             Node N2;
             N2.loc = hn;
             N2.g = N.g + k;
@@ -366,17 +462,9 @@ void AStar<Heuristic>::find_path(vector<HexCoord>& path)
                 // It's in OPEN, and our new g is better, update
                 if( pq.is_open(hn) && N2.g < pq.g_value(hn) )
                 {
-                    // Search for hn in open
-                    Container::iterator find1 = pq.find_in_open(hn);
-                    Assert( find1 != pq.open.end() );
-                        
-                    // Replace *find1's g with N2.g in the list&map
-                    mark[hn].direction = ReverseDirection(d);
-                    mark[hn].g = N2.g;
-                    mark[hn].f = N2.g+N2.h;
-                    (*find1).g = N2.g;
-                    push_heap(pq.open.begin(), find1+1, comp);
-                    // propagate_down( *find1 );
+                    // Replace hn's g with N2.g in the heap&map
+                    pq.decrease_key(hn, N2.g, ReverseDirection(d));
+                    // propagate_down( hn );
                 }
             }
         }
@@ -389,7 +477,7 @@ void AStar<Heuristic>::find_path(vector<HexCoord>& path)
         HexCoord h = destination;
         while( h != source )
         {
-            Direction dir = mark[h].direction;
+            Direction dir = pq.mark[h].direction;
             path.push_back(h);
             h = Neighbor(h, dir);
             stats.path_length++;
@@ -410,12 +498,94 @@ void AStar<Heuristic>::find_path(vector<HexCoord>& path)
 ////////////////////////////////////////////////////////////////////////
 // Specific instantiations of A* for different purposes
 
+// The cost of a step from a to b, not counting blobs in the way
+static int step_cost(Map& m, const HexCoord& a, const HexCoord& b, int pd)
+{
+    // Roads are faster (twice as fast), and cancel altitude effects
+    Terrain t1 = m.terrain(a);
+    Terrain t2 = m.terrain(b);
+    //      int rd = int((t2==Road||t2==Bridge)&&(t1==Road||t2==Bridge));
+    // It'd be better theoretically for roads to work only when both
+    // hexes are roads, BUT the path finder works faster when
+    // it works just when the destination is a road, because it can
+    // just step onto a road and know it's going somewhere, as opposed
+    // to having to step on the road AND take another step.
+    int rd = int(t2==Road || t2==Bridge);
+    int rdv = ( 5 - 10 * rd ) * (pd - 3) / 5;
+    // Slow everyone down on gates, canals, or walls
+    if( t2 == Wall )
+        rdv += 150;
+    else if( t2 == Gate || t2 == Canal )
+        rdv += 50;
+    // Slow down everyone on water, unless it's on a bridge
+    if( t2 != Bridge && m.water(b) > 0 )
+        rdv += 30;
+    // If there's no road, I take additional items into account
+    if( !rd )
+    {
+        // One thing we can do is penalize for getting OFF a road
+        if( t1==Road || t1==Bridge )
+            rdv += 15;
+        // I take the difference in altitude and use that as a cost,
+        // in units of ALTITUDE_SCALE, which means that small differences
+        // usually cost 0.  Each altitude is rounded down before
+        // subtracting so that the cost only changes when set_altitude
+        // says it does (cost_change).
+        // ALTITUDE_SCALE is NUM_TERRAIN_TILES/x, so da is at most x.
+        int da = m.altitude(b)/ALTITUDE_SCALE - m.altitude(a)/ALTITUDE_SCALE;
+        if( da > 0 )
+            rdv += da * (pd-3);
+    }
+    return 10 + rdv;
+}
+
+// Rebuild one hex's row of the step cost cache
+static void fill_edge_costs(Map& m, const HexCoord& a)
+{
+    EdgeCosts& row = m.edge_costs_[a];
+    for( int d = 0; d < 6; ++d )
+    {
+        HexCoord b = Neighbor(a, HexDirection(d));
+        row.cost[d] = m.valid(b)? step_cost(m, a, b, m.edge_div_) : 0;
+    }
+    m.edge_dirty_[a] = 0;
+}
+
+const EdgeCosts& step_costs(Map& m, const HexCoord& a)
+{
+    if( m.edge_dirty_[a] )
+        fill_edge_costs(m, a);
+    return m.edge_costs_[a];
+}
+
+// Fill in every row that is out of date, so that the searches that
+// follow never have to write to the cache
+void prepare_edge_costs(Map& m)
+{
+    int pd = path_div;
+    bool all = ( pd != m.edge_div_ );
+    m.edge_div_ = pd;
+    for( int i = 1; i <= Map::MSize; ++i )
+        for( int j = 1; j <= Map::NSize; ++j )
+        {
+            HexCoord h(i,j);
+            if( all || m.edge_dirty_[h] )
+                fill_edge_costs(m, h);
+        }
+}
+
 // UnitMovement is for moving units (soldiers, builders, firefighters)
 struct UnitMovement
 {
     HexCoord source;
     Unit* unit;
     int abort_path;
+    int div;            // path_div, read once per search instead of per step
+    bool ignore_units;  // for costs that are cached, like the sector graph
+    bool reserve;       // avoid hexes other blobs have reserved
+
+    UnitMovement(): unit(NULL), abort_path(0), div(path_div),
+                    ignore_units(false), reserve(false) {}
 
     inline static int dist(const HexCoord& a, const HexCoord& b)
     {
@@ -441,6 +611,14 @@ struct UnitMovement
     inline int dist(Map& m, const HexCoord& a, const HexCoord& b)
     {
         int d = dist(a, b);
+
+        // The landmarks know about walls, water, and hills, so they
+        // can give a better estimate than the hex distance
+        if( div == landmarks.div )
+        {
+            int lb = landmarks.lower_bound(a, b);
+            if( lb > d ) d = lb;
+        }
         if( d > 40 )
         {
             // Only add a correction for longer distances
@@ -463,47 +641,33 @@ struct UnitMovement
         // paths, this must be greater than or equal to the change in the
         // distance function when you take a step.
 
-        if( pd == -1 ) pd = path_div;
+        if( pd == -1 ) pd = div;
         
-        // Check for neighboring moving obstacles
-        int occ = m.occupied_[b];
-        if( ( occ != -1 && m.units[occ] != unit ) &&
-            ( !m.units[occ]->moving() || ( source == a && d != DirNone ) ) )
+        // Check for neighboring moving obstacles.  Blobs move every
+        // step, so they are checked here and not kept in the cache.
+        // Moving blobs only block the first step, since they'll be gone
+        // before we get any farther.
+        if( !ignore_units && m.occupied_[b] != -1 &&
+            m.blocked( b, unit, source == a && d != DirNone ) )
                 return MAXIMUM_PATH_LENGTH;
 
-        // Roads are faster (twice as fast), and cancel altitude effects
-        Terrain t1 = m.terrain(a);
-        Terrain t2 = m.terrain(b);
-        //      int rd = int((t2==Road||t2==Bridge)&&(t1==Road||t2==Bridge));
-        // It'd be better theoretically for roads to work only when both
-        // hexes are roads, BUT the path finder works faster when
-        // it works just when the destination is a road, because it can
-        // just step onto a road and know it's going somewhere, as opposed
-        // to having to step on the road AND take another step.
-        int rd = int(t2==Road || t2==Bridge);
-        int rdv = ( 5 - 10 * rd ) * (pd - 3) / 5;
-        // Slow everyone down on gates, canals, or walls
-        if( t2 == Wall )
-            rdv += 150;
-        else if( t2 == Gate || t2 == Canal )
-            rdv += 50;
-        // Slow down everyone on water, unless it's on a bridge
-        if( t2 != Bridge && m.water(b) > 0 )
-            rdv += 30;
-        // If there's no road, I take additional items into account
-        if( !rd )
-        {
-            // One thing we can do is penalize for getting OFF a road
-            if( t1==Road || t1==Bridge )
-                rdv += 15;
-            // I take the difference in altitude and use that as a cost,
-            // rounded down, which means that small differences cost 0
-            // ALTITUDE_SCALE is NUM_TERRAIN_TILES/x, so da is at most x.
-            int da = (m.altitude(b)-m.altitude(a))/ALTITUDE_SCALE;
-            if( da > 0 )
-                rdv += da * (pd-3);
-        }
-        return 10 + rdv;
+        // Steps to a neighbor come from the cache, if it's for this pd.
+        // Searches only read the cache, so that they can run on several
+        // threads at once; a row that changed during the batch (the map
+        // can be edited from the window) is worked out here instead.
+        if( d != DirNone && pd == m.edge_div_ && !m.edge_dirty_[a] )
+            return m.edge_costs_[a].cost[d];
+        return step_cost(m, a, b, pd);
+    }
+
+    // The extra cost of getting to b, g from now, if another blob has
+    // reserved it for then.  Waiting is about as bad as a long detour.
+    inline int delay(Map& m, const HexCoord& b, int g)
+    {
+        if( !reserve || unit == NULL )
+            return 0;
+        long t = m.time_tick_ + step_ticks(g);
+        return reservations.reserved(m, b, t, unit)? RESERVE_PENALTY : 0;
     }
 };
 
@@ -521,6 +685,20 @@ int movement_cost(Map& m, HexCoord a, HexCoord b, Unit* unit)
     return um.kost(m, a, DirNone, b, 8);
 }
 
+int static_movement_cost(Map& m, HexCoord a, HexCoord b)
+{
+    UnitMovement um;
+    um.ignore_units = true;
+    return um.kost(m, a, DirNone, b);
+}
+
+int static_movement_cost(Map& m, HexCoord a, HexDirection d)
+{
+    UnitMovement um;
+    um.ignore_units = true;
+    return um.kost(m, a, d, Neighbor(a, d));
+}
+
 // BuildingMovement is for drawing straight lines (!)
 struct BuildingMovement
 {
@@ -548,11 +726,61 @@ struct BuildingMovement
     {
         return 0;
     }
+
+    inline int delay(Map&, const HexCoord&, int)
+    {
+        return 0;
+    }
 };
 
 //////////////////////////////////////////////////////////////////////
 // These functions call AStar with the proper heuristic object
 
+// Paths at least this long are planned on the sector graph first
+const int HIERARCHICAL_DISTANCE = 10*(SECTOR_X_SIZE+SECTOR_Y_SIZE);
+
+// Fill in the detailed path from A through each waypoint to B.  Since
+// paths are kept backwards, the last leg is found first.  Each leg is
+// short, so the usual cutoff is plenty.  Returns false (leaving path the
+// way it was) if any leg could not get to its end.
+static bool refine_path(Map& map, HexCoord A, HexCoord B,
+                        const vector<HexCoord>& waypoints,
+                        vector<HexCoord>& path, UnitMovement um,
+                        PathStats& stats)
+{
+    int init_size = path.size();
+    vector<HexCoord> points;
+    points.push_back(A);
+    points.insert(points.end(), waypoints.begin(), waypoints.end());
+    points.push_back(B);
+
+    for( int i = points.size()-2; i >= 0; --i )
+    {
+        um.source = points[i];
+        um.abort_path = BasePathCutoff
+            + PathCutoff * hex_distance(points[i], points[i+1]) / 10;
+        AStar<UnitMovement> leg(um, map, points[i], points[i+1]);
+        int size = path.size();
+        leg.find_path(path);
+        if( leg.destination != points[i+1] || path.size() == size )
+        {
+            path.erase(path.begin()+init_size, path.end());
+            return false;
+        }
+
+        // The next leg ends where this one starts
+        if( i > 0 ) path.pop_back();
+
+        stats.nodes_added += leg.stats.nodes_added;
+        stats.nodes_removed += leg.stats.nodes_removed;
+        stats.nodes_visited += leg.stats.nodes_visited;
+        stats.nodes_left += leg.stats.nodes_left;
+        stats.path_length += leg.stats.path_length;
+        stats.path_cost += leg.stats.path_cost;
+    }
+    return true;
+}
+
 PathStats FindUnitPath(Map& map, HexCoord A, HexCoord B, 
                        vector<HexCoord>& path, Unit* unit, int cutoff)
 {
@@ -560,6 +788,7 @@ PathStats FindUnitPath(Map& map, HexCoord A, HexCoord B,
     um.source = A;
     um.unit = unit;
     um.abort_path = BasePathCutoff + cutoff * hex_distance(A,B) / 10;
+    um.reserve = map.reserving_;
 
     AStar<UnitMovement> finder(um, map, A, B);
 
@@ -593,6 +822,16 @@ PathStats FindUnitPath(Map& map, HexCoord A, HexCoord B,
         }
     }
 
+    // Long paths go through the sector graph, which finds good routes
+    // without having to give up at the cutoff
+    if( hex_distance(A,B) >= HIERARCHICAL_DISTANCE )
+    {
+        vector<HexCoord> waypoints;
+        if( path_graph.find_path(map, A, B, waypoints) &&
+            refine_path(map, A, B, waypoints, path, um, finder.stats) )
+            return finder.stats;
+    }
+
     clock_t c0 = clock();
     finder.find_path(path);
     int num_searches = 1;
@@ -17,7 +17,6 @@
 #include "Map.h"
 #include "stl.h"
 
-#define ALTITUDE_SCALE (NUM_TERRAIN_TILES/16)
 #define MAXIMUM_PATH_LENGTH 100000
 
 // Statistics about the path are kept in this structure
@@ -36,6 +35,9 @@ struct PathStats
     {}
 };
 
+// Lower values of path_div make paths worse but faster to find
+extern Subject<int> path_div;
+
 const int PathCutoff = 35;      // default cutoff
 const int BasePathCutoff = PathCutoff*15;
 PathStats FindUnitPath( Map& map, HexCoord A, HexCoord B,
@@ -46,6 +48,24 @@ PathStats FindBuildPath( Map& map, HexCoord A, HexCoord B,
 
 int hex_distance( HexCoord a, HexCoord b );
 int movement_cost( Map& m, HexCoord a, HexCoord b, Unit* unit );
+int static_movement_cost( Map& m, HexCoord a, HexCoord b ); // no units
+int static_movement_cost( Map& m, HexCoord a, HexDirection d ); // cached
+
+// Bring the step cost cache (Map::edge_costs_) up to date with path_div
+// and the map, filling in every row that changed.  Call this before
+// searching, while no other thread is searching.  Searches only read
+// the cache, and the sector graph and flow fields have locks of their
+// own, so FindUnitPath can run on several threads at once.
+void prepare_edge_costs( Map& m );
+// One row of the cache, filled in if it's out of date; for the
+// simulation thread only
+const EdgeCosts& step_costs( Map& m, const HexCoord& h );
+
+// Time FindUnitPath and FindBuildPath on a corpus of queries, with each
+// setting of path_div, and write latency percentiles, nodes expanded per
+// query, and how far the paths are from the best to the log.  If the
+// corpus file can't be read, a new one is made from the seed and saved.
+void PathBenchmark( const char* corpus, unsigned long seed );
 
 #endif
 
@@ -25,6 +25,8 @@
 #include "MainWin.h"
 
 #include "Blitter.h"
+#include "Replay.h"
+#include "Path.h"
 
 // main entry point
 int main( int argc, const char* argv[] )
@@ -33,6 +35,29 @@ int main( int argc, const char* argv[] )
     if( Figment::Initialize() == FALSE )
         AbortProgram( (HWND)NULL, (HWND)NULL );
 
+    // "simblob replay <log> [ticks [lod]]" runs a replay log without
+    // any windows; with "lod" it measures level of detail against the
+    // previous full-rate run
+    if( argc > 2 && !stricmp( argv[1], "replay" ) )
+    {
+        ReplayRun( argv[2], argc > 3? atol(argv[3]) : -1,
+                   argc > 4 && !stricmp( argv[4], "lod" ) );
+        Figment::Terminate();
+        return 0;
+    }
+
+    // "simblob pathbench [seed | corpus]" times the path finder on a
+    // corpus of queries; a seed makes a new corpus in pathbench.txt
+    if( argc > 1 && !stricmp( argv[1], "pathbench" ) )
+    {
+        if( argc > 2 && argv[2][0] >= '0' && argv[2][0] <= '9' )
+            PathBenchmark( NULL, strtoul( argv[2], NULL, 10 ) );
+        else
+            PathBenchmark( argc > 2? argv[2] : "pathbench.txt", 1 );
+        Figment::Terminate();
+        return 0;
+    }
+    
     // Determine what the args are
     if( argc > 1 )
     {
@@ -44,6 +44,9 @@ extern VOID AbortProgram(HWND hwndFrame,HWND hwndClient);
 
 #define ID_OPTIONS              300
 #define ID_OPTIONS_DROUGHT      301
+#define ID_OPTIONS_SLEEP        302
+#define ID_OPTIONS_LOD          303
+#define ID_OPTIONS_RESERVE      304
 
 #define ID_PATHS                310
 #define ID_PATH_BEST            311
@@ -65,6 +68,7 @@ extern VOID AbortProgram(HWND hwndFrame,HWND hwndClient);
 #define ID_SPECIAL_FLASH_FLOOD  351
 #define ID_SPECIAL_ERASE        352
 #define ID_SPECIAL_ROADS        353
+#define ID_SPECIAL_REWIND       354
 
 #define ID_VIEW                 360
 #define ID_VIEW_ROADS           361
@@ -18,13 +18,23 @@
 
 #include <algo.h>
 
+// Move alt0 toward alt1 by k/rate of the difference (k steps at once,
+// for hexes simulated at a lower level of detail)
+inline int erode( int alt0, int alt1, int rate, int k )
+{
+    if( k > rate/2 ) k = rate/2;
+    return ( alt0*(rate-k) + alt1*k + rate/2 ) / rate;
+}
+
 void Map::smooth_terrain( int num_hexes )
 {
-    static int pos = 0;
+    static int pos = 0, pass = 0;
     for( int i = 0; i < num_hexes; ++i )
     {       
         HexCoord h; hex_position( pos++, h );
-        if( pos >= NUM_HEXES ) pos = 0;
+        if( pos >= NUM_HEXES ) { pos = 0; ++pass; }
+        if( asleep( h ) || lod_skip( h, pass ) ) continue;
+        int k = lod( h );
 
         // Don't change anything if erosion isn't allowed here
         if( !erosion( h ) )
@@ -56,23 +66,23 @@ void Map::smooth_terrain( int num_hexes )
 
         if( w0 || moisture( h ) > (3+MAX_MOISTURE)/4 )
             // Near rivers, erosion is very slow
-            set_altitude( h, (alt0*129 + alt1 + 65) / 130 );
+            set_altitude( h, erode( alt0, alt1, 130, k ) );
         else if( alt0 > MIN_DESERT && water( h ) <= 0 )
         {
             Terrain t = terrain(h);
             if( t == Farm || t == Houses )
                 // civilization leads to high erosion
-                set_altitude( h, (alt0*5 + alt1 + 3) / 6 );
+                set_altitude( h, erode( alt0, alt1, 6, k ) );
             else if( alt0 > MAX_DESERT || t == Trees || t == Wall )
                 // mountain erosion is medium
-                set_altitude( h, (alt0*49 + alt1 + 25) / 50 );
+                set_altitude( h, erode( alt0, alt1, 50, k ) );
             else
                 // desert erosion is slow
-                set_altitude( h, (alt0*79 + alt1 + 40) / 80 );
+                set_altitude( h, erode( alt0, alt1, 80, k ) );
         }
         else
             // lowland erosion is fast, to smooth out valleys
-            set_altitude( h, (alt0*15 + alt1 + 8) / 16 );
+            set_altitude( h, erode( alt0, alt1, 16, k ) );
     }
 }
 
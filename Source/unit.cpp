@@ -15,6 +15,9 @@
 #include "Notion.h"
 #include "Path.h"
 #include "Unit.h"
+#include "PathPlanner.h"
+#include "Reservations.h"
+#include "JobIndex.h"
 
 #include <algo.h>
 
@@ -32,23 +35,28 @@ void JobSet( int i, const HexCoord& location, Terrain t )
     jobs[i].blob = -1;
     jobs[i].location = location;
     jobs[i].build = t;
+    job_index.insert( i );
 }
 
 void JobKill( int i )
 {
     if( jobs[i].build != -1 ) --num_jobs;
     jobs[i].build = -1;
+    job_index.remove( i );
 }
 
 void JobBlobAccepted( int i, int b )
 {
     jobs[i].blob = b;           
+    job_index.remove( i );
 }
 
 void JobBlobAborted( int i )
 {
     // A blob no longer wants to work on this job
     jobs[i].blob = -1;
+    if( jobs[i].build != -1 )
+        job_index.insert( i );
 }
 
 void JobBlobFinished( int i )
@@ -58,8 +66,51 @@ void JobBlobFinished( int i )
 }
 
 //////////////////////////////////////////////////////////////////////
+// PATHS
 
-PathStats stats;
+void PackedPath::assign( const vector<HexCoord>& reversed )
+{
+    clear();
+    int n = reversed.size();
+    if( n == 0 )
+        return;
+
+    here = reversed[n-1];
+    end = reversed[0];
+    length = 1;
+    unsigned long word = 0;
+    int in_word = 0;
+    HexCoord h = here;
+    for( int i = n-2; i >= 0; --i )
+    {
+        HexCoord h2 = reversed[i];
+        if( h2 == h )
+            continue;           // the same hex twice, where two legs meet
+        int d = 0;
+        while( d < 6 && Neighbor( h, HexDirection(d) ) != h2 )
+            ++d;
+        if( d == 6 )
+        {
+            // Not a neighbor; walk as far as the gap
+            end = h;
+            break;
+        }
+
+        word |= (unsigned long)(d) << ( 3*in_word );
+        if( ++in_word == STEPS_PER_WORD )
+        {
+            steps.push_back( word );
+            word = 0;
+            in_word = 0;
+        }
+        h = h2;
+        length++;
+    }
+    if( in_word > 0 )
+        steps.push_back( word );
+}
+
+//////////////////////////////////////////////////////////////////////
 
 // Notes:
 
@@ -68,12 +119,18 @@ PathStats stats;
 //  agitated == 63   means we should move anywhere
 //  agitated++       when we are not moving and have nothing to do
 
+// The blobs in a hex are kept in a list, newest first.  Each blob in
+// the list is hashed on its own, so the order doesn't matter.
 static void m_add( Map* map, Unit* unit, const HexCoord& h )
 {
-    if( map->occupied_[h] == -1 )
+    if( map->has_room( h ) )
     {
         int pos = unit->pos(map);
+        map->hash_change( h, HashUnit, -1, pos );
+        unit->next_here = map->occupied_[h];
         map->occupied_[h] = pos;
+        map->occupants_[h]++;
+        map->file_unit( pos, h );
         map->damage( h );
     }
     else
@@ -82,9 +139,18 @@ static void m_add( Map* map, Unit* unit, const HexCoord& h )
 
 static void m_del( Map* map, Unit* unit, const HexCoord& h )
 {
-    if( map->units[map->occupied_[h]] == unit )
+    int pos = unit->pos(map);
+    int* link = &map->occupied_[h];
+    while( *link != -1 && *link != pos )
+        link = &map->units[*link]->next_here;
+
+    if( *link == pos )
     {
-        map->occupied_[h] = -1;
+        map->hash_change( h, HashUnit, pos, -1 );
+        *link = unit->next_here;
+        unit->next_here = -1;
+        map->occupants_[h]--;
+        map->unfile_unit( pos, h );
         map->damage( h );
     }
     else
@@ -103,15 +169,49 @@ static void m_mov( Map* map, Unit* unit,
 
 static unsigned int next_unit_id = 1;
 
+// Blobs are made UNIT_BLOCK at a time, in one array, and never freed, so
+// a blob's index and address stay the same.  A blob that dies stays in
+// Map::live_units until the next sweep, and then waits on the free list
+// until Unit::make brings it back to life.  Its path keeps its storage,
+// so living blobs don't allocate much either.
+const int UNIT_BLOCK = 256;
+static vector<Unit*> free_units;
+
 Unit* Unit::make( Map* map, Unit::Type t, const HexCoord& h )
 {
     // Don't make a new unit if there's a dead one available
-    Unit* unit = new Unit( map->units.size() );
-    map->units.push_back( unit );
+    if( free_units.empty() )
+    {
+        Unit* block = new Unit[UNIT_BLOCK];
+        for( int i = 0; i < UNIT_BLOCK; i++ )
+        {
+            block[i].index = map->units.size();
+            map->units.push_back( &block[i] );
+        }
+        // The lowest index is used first
+        for( int i = UNIT_BLOCK-1; i >= 0; i-- )
+            free_units.push_back( &block[i] );
+    }
+
+    Unit* unit = free_units.back();
+    free_units.pop_back();
+    map->live_units.push_back( unit );
     unit->reincarnate( map, t, h );
     return unit;
 }
 
+void Unit::sweep( Map* map )
+{
+    vector<Unit*>& live = map->live_units;
+    vector<Unit*>::iterator out = live.begin();
+    for( vector<Unit*>::iterator u = live.begin(); u != live.end(); ++u )
+        if( (*u)->dead() )
+            free_units.push_back( *u );
+        else
+            *out++ = *u;
+    live.erase( out, live.end() );
+}
+
 void Unit::destroy( Unit* unit, Map* map )
 {
     // Don't delete it .. just kill it!
@@ -133,7 +233,9 @@ void Unit::reincarnate( Map* map, Unit::Type t, HexCoord h )
     agitated = 0;
     j = 0;
     nsteps = 0;
+    wait_steps = 0;
     path.clear();
+    plan_ticket = 0;
 
     type = t;
     for( int i = 0; i < MaxJobs; i++ )
@@ -160,6 +262,8 @@ void Unit::die( Map* map )
     }
     
     // stop walking
+    plan_ticket = 0;
+    ++reserve_number;
     m_del( map, this, loc );
     id = DEAD_ID;
     type = Idle;
@@ -169,7 +273,9 @@ void Unit::die( Map* map )
 //////////////////////////////////////////////////////////////////////
 
 Unit::Unit( int index_ )
-    : index(index_), id(DEAD_ID), loc(0,0), type(Idle)
+    : index(index_), next_here(-1), id(DEAD_ID), plan_ticket(0),
+      reserve_number(0),
+      loc(0,0), type(Idle)
 {
 }
 
@@ -206,23 +312,17 @@ HexCoord Unit::hexloc_left()
 HexCoord Unit::hexloc_right()
 {
     if( moving() )
-        return path[path.size()-1];
+        return path.current();
     else
         return hexloc();
 }
 
 void Unit::handle_blocked_movement( Map* map )
 {
-    int n = path.size();    
     if( wait_steps > 0 )
         wait_steps--;
-    else if( n > 0 && path[n-1] != path[0] )
-    {
-        if( n > 15 )
-            update_path( map, 10 );
-        else
-            set_dest( map, final_dest );
-    }
+    else if( path.size() > 0 && path.current() != path.goal() )
+        replan( map );
     else
         stop();
 }
@@ -238,24 +338,24 @@ void Unit::step( Map* map )
     // Check to see if we've run into a wall or water
     if( j >= nsteps / 2 )
     {
-        // n-1 is the immediate destination; 0 is the long term destination
-        int i = max(n-2,0);
-        if( j <= nsteps/2 )
-            i = max(n-1,0);
-        HexCoord A = path[i];
-
-        bool blocked = false;
-        int occ = map->occupied_[A];
-        if( occ != -1 && map->units[occ] != this )
-        {
-            blocked = true;
-            if( map->units[occ]->wait_steps < NUM_WAIT_STEPS && 
-                map->units[occ]->wait_steps > NUM_WAIT_STEPS / 3 )
+        // current() is the immediate destination; goal() is the long
+        // term destination
+        HexCoord A = ( j <= nsteps/2 )? path.current() : path.next();
+
+        bool blocked = map->blocked( A, this, true );
+        if( blocked )
+            for( int occ = map->occupied_[A]; occ != -1;
+                 occ = map->units[occ]->next_here )
             {
-                // The other guy's waiting for us, so don't wait at all
-                wait_steps = 0;
+                Unit* other = map->units[occ];
+                if( other != this &&
+                    other->wait_steps < NUM_WAIT_STEPS && 
+                    other->wait_steps > NUM_WAIT_STEPS / 3 )
+                {
+                    // The other guy's waiting for us, so don't wait at all
+                    wait_steps = 0;
+                }
             }
-        }       
 
         if( blocked )
         {
@@ -267,7 +367,7 @@ void Unit::step( Map* map )
         if( j == nsteps / 2 )
         {
             prev_loc = loc;
-            loc = path[n-1];
+            loc = path.current();
             m_mov( map, this, prev_loc, loc );
         }
     }
@@ -278,13 +378,14 @@ void Unit::step( Map* map )
     while( j >= nsteps && n > 0 )
     {
         j = 0;
-        path.pop_back();
+        path.advance();
         source = dest;
         n = path.size();
-        int l = max(0,n-1);
-        int r = max(n-2,0);
-        dest = Point( ( path[l].x() + path[r].x() ) / 2,
-                      ( path[l].y() + path[r].y() ) / 2 );
+        if( n == 0 )
+            break;
+        HexCoord l = path.current();
+        HexCoord r = path.next();
+        dest = Point( ( l.x() + r.x() ) / 2, ( l.y() + r.y() ) / 2 );
         // dest should be on the border between two hexes
         // unless it's an endpoint
 
@@ -293,7 +394,7 @@ void Unit::step( Map* map )
         int dist = int( sqrt( (dx*dx) + (dy*dy) ) );
 
         // This is 10 times the cost
-        int kost = movement_cost( *map, path[l], path[r], this );
+        int kost = movement_cost( *map, l, r, this );
         if( kost == MAXIMUM_PATH_LENGTH )
         {
             // We can't take the next step
@@ -327,19 +428,14 @@ void Unit::stop()
     // stop waiting
     wait_steps = NUM_WAIT_STEPS;
 
-    // stop macro-movement
+    // stop macro-movement, including any path we asked for, and let
+    // other blobs have the hexes we reserved
     path.clear();
+    plan_ticket = 0;
+    ++reserve_number;
 }
 
-static bool is_neighbor( HexCoord A, HexCoord B )
-{
-    for( int d = 0; d < 6; d++ )
-        if( B == Neighbor( A, HexDirection(d) ) )
-            return true;
-    return false;
-}
-
-void Unit::set_dest( Map* map, HexCoord B )
+void Unit::set_dest( Map* map, HexCoord B, bool shared )
 {
     agitated = 0;
     
@@ -358,60 +454,52 @@ void Unit::set_dest( Map* map, HexCoord B )
 
         if( map->valid( A ) )
         {
-            // Set up macro-movement
-            int init_size = path.size();
-            if( init_size == 0 )
-                path.reserve(16); // keep it small
-            
-            // Increase the cutoff for the path when we are retrying repeatedly
-            stats = FindUnitPath( *map, A, B, path, this,
-                                  PathCutoff*(2+num_attempts)/2 );
-            int n = path.size();
-
-            // Check if we got a valid path
-            if( n > init_size )
-            {
-                // Set up micro-movement
-                Point s = gridloc();
-
-                source = s;
-                dest = s;
-                j = 0;
-                nsteps = 0;
-            }
-            else
-                stop();
+            // Ask for a path; it will be here next tick.  Increase the
+            // cutoff for the path when we are retrying repeatedly (a
+            // retry doesn't use the flow field, since it led us here)
+            plan_ticket = path_planner.post( this, A, B,
+                                             PathCutoff*(2+num_attempts)/2,
+                                             shared && num_attempts == 0,
+                                             false );
         }
     }
 }
 
-void Unit::update_path( Map* map, int steps_to_update )
+void Unit::replan( Map* map )
 {
-    int n = path.size();
-    HexCoord A = path[n-1];
-
-    // Erase part of the path
-    path.erase( path.begin()+n-steps_to_update, path.end() );
-    n -= steps_to_update;
+    // The same as set_dest( map, final_dest ), except that if we were
+    // blocked on the way there before, the last search can be repaired
+    agitated = 0;
+    num_attempts++;
 
-    // Prepend a new subpath to our main path, with a smaller cutoff
-    FindUnitPath( *map, A, path[n-1], path, this, PathCutoff/2 );
+    HexCoord A = hexloc();
+    stop();
+    if( map->valid( A ) && map->valid( final_dest ) )
+        plan_ticket = path_planner.post( this, A, final_dest,
+                                         PathCutoff*(2+num_attempts)/2,
+                                         false, true );
+}
 
-    // Check to see if the path is okay
-    if( path.size() <= n )
-    {
-        // Redo the whole path
-        set_dest( map, final_dest );
-    }
-    else if( !is_neighbor( path[n-1], path[n] ) )
+void Unit::receive_path( Map* map, PathRequest& r )
+{
+    plan_ticket = 0;
+    path.assign( r.path );
+    ++reserve_number;
+    if( path.size() > 0 )
     {
-        // A good graft could not be made, so let's cancel the remaining path
-        path.erase( path.begin(), path.begin() + n );
-    }
+        if( map->reserving_ )
+            reservations.reserve( *map, this, r.path );
 
-    // Reset the micromovement
-    j = 0;
-    nsteps = 0;
+        // Set up micro-movement
+        Point s = gridloc();
+
+        source = s;
+        dest = s;
+        j = 0;
+        nsteps = 0;
+    }
+    else
+        stop();
 }
 
 // Unit commands to perform jobs
@@ -446,7 +534,7 @@ void Unit::accept_job( int jb )
 
 void Unit::perform_movement( Map* map )
 {
-    if( !moving() ) return;
+    if( !moving() || planning() ) return;
 
     Point p1 = gridloc();
     step( map );
@@ -465,7 +553,7 @@ void Unit::perform_movement( Map* map )
 
 void Unit::perform_jobs( Map* map )
 {
-    bool is_moving = moving();
+    bool is_moving = moving() || planning();
     HexCoord h(hexloc());
     int incomplete_job = -1;
     for( int k = 0; k < MaxJobs; k++ )
@@ -539,38 +627,14 @@ void Unit::perform_jobs( Map* map )
         }
         else if( type == Builder && money > 0 && agitated % 8 == 0 )
         {
-            // If there are no jobs to do, fill up our queue,
-            // choosing close jobs first.  Pick up to jobs_acceptable
-            // jobs to do.
-            int jobs_acceptable = MaxJobs;
-            int jobs_accepted = 0;
-            HexCoord last_job( h );
-            for( int factor = 256; factor >= 1 && jobs_accepted == 0;
-                 factor /= 4 )
-            {
-                // Stop worrying about finding jobs if we found just one...
-                // but pick up as many as possible in a particular range
-                for( int k = 0; k < ::jobs.size() &&
-                         jobs_accepted < jobs_acceptable; ++k )
-                {
-                    if( ::jobs[k].build != -1 &&
-                        ::jobs[k].blob == -1 &&
-                        hex_distance( last_job, ::jobs[k].location )
-                        < 6000 / factor )
-                    {
-                        // This is a real job that hasn't been taken yet
-                        accept_job( k );
-                        last_job = ::jobs[k].location;
-                        map->damage( last_job );
-                        jobs_accepted++;
-                    }
-                }
-            }
+            // If there are no jobs to do, ask for some.  The jobs are
+            // handed out to all the idle builders at the end of the tick.
+            job_index.want_jobs( this );
         }
     }
     
     // If we're STILL not moving, just move randomly
-    if( !moving() )
+    if( !moving() && !planning() )
     {
         if( agitated >= 63 )
         {
@@ -14,6 +14,7 @@
 #define Unit_h
 
 class Map;
+struct PathRequest;
 
 const int Unit_size_x = 16;
 const int Unit_size_y = 16;
@@ -31,6 +32,51 @@ extern vector<Job> jobs;
 
 const int DEAD_ID = -1;
 
+// A blob's path, stored as the hex it starts in and the direction of
+// each step after that, three bits a step and ten steps to a word.  A
+// blob only looks at the hex it's in, the next one, and the last one,
+// so it moves a cursor along the path instead of taking hexes off it.
+class PackedPath
+{
+  public:
+    PackedPath(): length(0), cursor(0) {}
+    ~PackedPath() {}
+
+    // Fill in from a path as the path finder makes it (in reverse order)
+    void assign( const vector<HexCoord>& reversed );
+    void clear()
+    {
+        steps.erase( steps.begin(), steps.end() );
+        length = cursor = 0;
+    }
+
+    int size() const { return length - cursor; }    // hexes left, with this one
+    const HexCoord& current() const { return here; }
+    HexCoord next() const
+    { return size() > 1? Neighbor( here, direction( cursor ) ) : here; }
+    const HexCoord& goal() const { return end; }
+
+    // Move on to the next hex
+    void advance()
+    {
+        if( ++cursor < length )
+            here = Neighbor( here, direction( cursor-1 ) );
+    }
+
+  private:
+    enum { STEPS_PER_WORD = 10 };
+    vector<unsigned long> steps;
+    int length;                 // number of hexes, including the first
+    int cursor;                 // number of hexes already left behind
+    HexCoord here, end;
+
+    HexDirection direction( int k ) const
+    {
+        return HexDirection( ( steps[k/STEPS_PER_WORD]
+                               >> ( 3*(k%STEPS_PER_WORD) ) ) & 7 );
+    }
+};
+
 // Represent a blob in the game world
 struct Unit
 {
@@ -38,7 +84,8 @@ struct Unit
                 
     int id;                     // -1 if dead
     bool dead() { return id == DEAD_ID; }
-    short index;                // index in the units vector
+    int index;                  // index in the units vector
+    int next_here;              // next blob in the same hex, or -1
 
     void reincarnate( Map*, Type t, HexCoord h );   // bring this unit to life
     void die( Map* );           // kill this unit
@@ -46,7 +93,9 @@ struct Unit
     HexCoord final_dest;
     short num_attempts;         // how many times we tried to get to dest
     short agitated;             // how agitated this unit is (0 == normal)
-    vector<HexCoord> path;      // where to walk, in reverse order
+    PackedPath path;            // where to walk
+    long plan_ticket;           // path request we're waiting for, or 0
+    short reserve_number;       // bumped to drop our reservations
     enum { MaxJobs = 6 };
     short jobs[MaxJobs];        // jobs assigned to this blob
 
@@ -62,6 +111,8 @@ struct Unit
 
     bool moving()   // is this unit moving?
     { return path.size() > 0; }
+    bool planning() // is this unit waiting for a path?
+    { return plan_ticket != 0; }
 
     bool busy();     // is this unit doing anything?
     bool too_busy(); // is this unit too busy to take a new job?
@@ -78,15 +129,18 @@ struct Unit
     void handle_blocked_movement( Map* map );  // what to do if we can't move
     void step( Map* map );  // move one step
     void stop();    // stop movement
-    void update_path( Map* map, int count );
-    void set_dest( Map* map, HexCoord new_dest );   // start moving towards a new dest
+    void replan( Map* map );    // find a new way around blobs in the way
+    void set_dest( Map* map, HexCoord new_dest,     // start moving towards a new dest
+                   bool shared = false );   // many blobs go there: use a flow field
+    void receive_path( Map* map, PathRequest& r );  // the planner's answer
 
   public:
-    Unit( int index_ );
+    Unit( int index_ = -1 );
     ~Unit() {}
 
     static Unit* make( Map* map, Type t, const HexCoord& location );
     static void destroy( Unit* unit, Map* map );
+    static void sweep( Map* map );  // recycle the blobs that have died
 };
 
 struct WatchtowerFire
@@ -79,26 +79,18 @@ void View::mark_damaged()
 
 static int RoadIndex( Map* map, const HexCoord& h )
 {
-    int index = 0;
-    for( unsigned d = 0; d < 6; d++ )
-    {
-        HexCoord h2 = Neighbor(h,HexDirection(d));
-        if( map->valid(h2) && ( map->terrain(h2) == Road || map->terrain(h2) == Bridge ) )
-            index |= (1<<d);
-    }
-    return index;
+    return map->hexes(Road).neighbors(h) | map->hexes(Bridge).neighbors(h);
 }
 
 static int WallIndex( Map* map, const HexCoord& h )
 {
-    int index = 0;
-    for( unsigned d = 0; d < 6; d++ )
-    {
-        HexCoord h2 = Neighbor(h,HexDirection(d));
-        Terrain t2 = map->valid(h2)? map->terrain(h2) : Wall;
-        if( t2 == Wall || t2 == Gate )
-            index |= (1<<d);
-    }
+    int index = map->hexes(Wall).neighbors(h) | map->hexes(Gate).neighbors(h);
+
+    // Walls run off the edge of the map
+    if( h.m == 1 || h.m == Map::MSize || h.n == 1 || h.n == Map::NSize )
+        for( unsigned d = 0; d < 6; d++ )
+            if( !map->valid( Neighbor(h,HexDirection(d)) ) )
+                index |= (1<<d);
     return index;
 }
 
@@ -279,6 +271,7 @@ class UnitView: public Layer
                      p.x+Unit_size_x/2+1, p.y+Unit_size_y/2+1 );
     }
     
+    // The blobs drawn last time, and where they were
     struct UnitCache
     {
         Unit* unit;
@@ -286,11 +279,8 @@ class UnitView: public Layer
         Point loc;
     };
     
-    int CACHE_SIZE;
-    UnitCache *cache;
-    int cache_length;
-    void build_cache( int size );
-    void destroy_cache();
+    vector<UnitCache> cache;
+    vector<Unit*> nearby;
     
     Map* map;
     View* view;
@@ -310,26 +300,10 @@ class UnitView: public Layer
 UnitView::UnitView( Map* m, View* v )
     :map(m), view(v)
 {
-    build_cache( 128 );
 }
 
 UnitView::~UnitView()
 {
-    destroy_cache();
-}
-
-void UnitView::build_cache( int size )
-{
-    CACHE_SIZE = size;
-    cache = new UnitCache[CACHE_SIZE];
-    cache_length = 0;
-}
-
-void UnitView::destroy_cache()
-{
-    delete[] cache;
-    cache = NULL;
-    cache_length = 0;
 }
 
 void UnitView::mark_damaged( const Rect& view_area, DamageArea& damaged )
@@ -347,51 +321,35 @@ void UnitView::mark_damaged( const Rect& view_area, DamageArea& damaged )
     }
 #endif
     
-    if( map->units.size() != 0 || cache_length != 0 )
+    if( map->live_units.size() != 0 || cache.size() != 0 )
     {
         Mutex::Lock lock( map->unit_mutex, 500 );
         if( lock.locked() )
         {
-            int cache_index = 0;
-            for( vector<Unit*>::iterator u = map->units.begin(); 
-                 (cache_index!=cache_length) || (u!=map->units.end()) ; )
+            // Blobs are never freed, so the cached pointers are still
+            // good.  If the id changed, the blob died (and may have been
+            // made again somewhere else).
+            for( int cache_index = 0; cache_index < cache.size();
+                 ++cache_index )
             {
-                Unit* unit = (u == map->units.end())? NULL : (*u);
-                int unit_id = (unit==NULL)? 0x7ffffff : unit->id;
-                int cache_id = (cache_index>=cache_length)? 
-                    0x7ffffff : (cache[cache_index].id);
-
-                if( cache_id < unit_id )
+                UnitCache& C = cache[cache_index];
+                if( C.unit->id != C.id || C.unit->gridloc() != C.loc )
                 {
-                    // Case 1:  Unit left the cache
-                    // This should always be the case when u is at end
-                    damaged += unit_area( cache[cache_index].loc );
-                    ++cache_index;
-                }
-                else if( cache_id == unit_id )
-                {
-                    // Case 2:  Unit stays around
-                    Point loc = unit->gridloc();
-                    if( loc != cache[cache_index].loc )
-                    {
-                        // The unit has moved
-                        damaged += unit_area( cache[cache_index].loc );
-                    }
-                    ++cache_index;
-                    ++u;
-                }
-                else
-                {
-                    // Case 3:  Unit moved out of cache
-                    // This should always be the case when cache iter at end
-                    ++u;
+                    // The unit left or moved
+                    damaged += unit_area( C.loc );
                 }
             }
             
-            // Build the cache
-            cache_length = 0;
-            for( vector<Unit*>::iterator u = map->units.begin();
-                 u != map->units.end(); ++u )
+            // Build the cache from the blobs filed near the view area.
+            // A blob is drawn up to a hex away from the hex it's filed
+            // under, so look a hex beyond the edges.
+            cache.erase( cache.begin(), cache.end() );
+            nearby.erase( nearby.begin(), nearby.end() );
+            int left, bottom, right, top;
+            View::rect_to_hexarea( view_area, left, bottom, right, top );
+            map->units_near( left-1, bottom-1, right+1, top+1, nearby );
+            for( vector<Unit*>::iterator u = nearby.begin();
+                 u != nearby.end(); ++u )
             {
                 Unit& unit = *(*u);
                 if( unit.dead() ) continue;
@@ -403,15 +361,13 @@ void UnitView::mark_damaged( const Rect& view_area, DamageArea& damaged )
                     p.y <= view_area.yTop+Unit_size_y )
                 {
                     damaged += unit_area( p );
-                    if( cache_length < CACHE_SIZE )
-                    {
-                        UnitCache& C = cache[cache_length++];
-                        C.unit = &unit;
-                        C.id = unit.id;
-                        C.loc = p;
-                        if( unit.moving() )
-                            damaged += unit_area( p );
-                    }
+                    UnitCache C;
+                    C.unit = &unit;
+                    C.id = unit.id;
+                    C.loc = p;
+                    cache.push_back( C );
+                    if( unit.moving() )
+                        damaged += unit_area( p );
                 }
             }
         }
@@ -456,7 +412,7 @@ void UnitView::draw_rect( PixelBuffer& buffer, const Point& origin,
     draw_train( *map, buffer, origin );
 #endif
     
-    for( int cache_index = 0; cache_index < cache_length; cache_index++ )
+    for( int cache_index = 0; cache_index < cache.size(); cache_index++ )
     {
         Point p = cache[cache_index].loc;
         int x = p.x-origin.x;
@@ -475,18 +431,11 @@ void UnitView::draw( PixelBuffer& buffer, const Point& origin,
                      DamageArea& damaged )
 {
     Layer::draw( buffer, origin, damaged );
-
-    // Resize the cache if necessary, for the next time through
-    if( cache_length == CACHE_SIZE )
-    {
-        destroy_cache();
-        build_cache( CACHE_SIZE * 2 );
-    }
 }
 
 HitResult UnitView::hit( Point p )
 {
-    for( int cache_index = 0; cache_index < cache_length; cache_index++ )
+    for( int cache_index = 0; cache_index < cache.size(); cache_index++ )
     {
         Point up = cache[cache_index].loc;
         Sprite* blob = &soldier_rle;
@@ -922,6 +871,14 @@ void View::update( const Rect& view_area, DamageArea& damaged,
     if( pb == NULL )
         return;
 
+    // After a rewind the damage stamps are older than last_update_, so
+    // everything has to be drawn again
+    if( rewinds_seen_ != map->rewinds_ )
+    {
+        rewinds_seen_ = map->rewinds_;
+        mark_damaged();
+    }
+
     if( !map_info ) map_info = new MapViewRecord( map, this );
     
     static HexCoord volcano_loc;
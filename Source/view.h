@@ -36,11 +36,12 @@ class View
   public:
     Mutex view_mutex;
     long last_update_;
+    long rewinds_seen_;         // map->rewinds_ at the last update
     int xoffset, yoffset;
 
     Point highlight;
     
-    View( Map* m ): map(m), last_update_(0), 
+    View( Map* m ): map(m), last_update_(0), rewinds_seen_(0),
         xoffset(0), yoffset(0) {}
 
     static void rect_to_hexarea( const Rect& r, int& left, int& bottom,
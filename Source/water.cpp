@@ -66,9 +66,11 @@ void Map::water_evaporation()
         HexCoord h; hex_position( pos++, h );
         if( pos >= NUM_HEXES ) pos = 0;
 
+        // Evaporation runs in sleeping sectors too, so that standing
+        // water dries up there, but by itself it doesn't wake them
         int w = water(h);
         if( w > 0 )
-            set_water( h, w*15/16 );
+            set_water( h, w*15/16, false );
     }
 }
 
@@ -79,6 +81,7 @@ void Map::water_flow()
     {       
         HexCoord h; hex_position( pos++, h );
         if( pos >= NUM_HEXES ) pos = 0;
+        if( asleep( h ) ) continue;
 
         int w0 = water(h);
         int a0 = altitude(h);
@@ -245,6 +248,7 @@ void Map::water_destruction()
     {
         HexCoord h; hex_position( pos++, h );
         if( pos >= NUM_HEXES ) pos = 0;
+        if( asleep( h ) ) continue;
         
         if( water(h) > 8 )
         {